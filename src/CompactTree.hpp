@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// a search tree in one arena: nodes hold only their statistics, sixteen bytes each, so four
+// siblings share a cache line, and the children of a node are one contiguous block of it.
+// nodes don't hold their positions, so the search replays the moves down from the root.
+// a node's value and proof are from the point of view of the player who moved into it.
+namespace CompactTree {
+
+struct Node {
+    enum Flags : uint8_t {
+        EXPANDED = 1,
+        // the game is over in this node's position
+        TERMINAL = 2,
+        // the player who moved into this node wins (or loses) with best play from here
+        PROVEN_WIN = 4,
+        PROVEN_LOSS = 8,
+    };
+
+    // the index of the first child in the arena; the rest follow it
+    uint32_t first_child = 0;
+    uint32_t visits = 0;
+    // the total of the results, each 1 for a win, 0 for a loss and a half for a draw
+    float value = 0;
+    uint16_t move = 0;
+    uint8_t num_children = 0;
+    uint8_t flags = 0;
+
+    auto has(uint8_t flag) const -> bool {
+        return flags & flag;
+    }
+
+    auto is_proven() const -> bool {
+        return flags & (PROVEN_WIN | PROVEN_LOSS);
+    }
+};
+
+static_assert(sizeof(Node) == 16, "CompactTree::Node should fill a quarter of a cache line");
+
+class Arena {
+    std::vector<Node> nodes;
+
+   public:
+    // the root is always at index 0
+    static constexpr uint32_t ROOT = 0;
+
+    void clear() {
+        nodes.clear();
+        nodes.emplace_back();
+    }
+
+    void reserve(size_t n) {
+        nodes.reserve(n);
+    }
+
+    // references are only good until the next allocate(), which may move the arena
+    auto operator[](uint32_t i) -> Node& {
+        return nodes[i];
+    }
+
+    auto operator[](uint32_t i) const -> const Node& {
+        return nodes[i];
+    }
+
+    // appends a block of children to parent, one per move
+    template <class Move>
+    void allocate(uint32_t parent, const std::vector<Move>& moves) {
+        auto first = static_cast<uint32_t>(nodes.size());
+        for (auto move : moves) {
+            Node child;
+            child.move = static_cast<uint16_t>(move);
+            nodes.push_back(child);
+        }
+        nodes[parent].first_child = first;
+        nodes[parent].num_children = static_cast<uint8_t>(moves.size());
+        nodes[parent].flags |= Node::EXPANDED;
+    }
+
+    auto size() const -> size_t {
+        return nodes.size();
+    }
+
+    auto memory_usage() const -> size_t {
+        return nodes.capacity() * sizeof(Node);
+    }
+};
+
+}  // namespace CompactTree
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// the interface that the search drivers (MCTS, Negamax, Perft) require of a game.
+// evaluate() returns the winner from X's perspective (1 / 0 / -1).
+template <class State>
+concept GameState = std::default_initializable<State> && std::copyable<State> &&
+    requires(State s, const State cs, typename State::Move m) {
+        { State::GAME_SOLVABLE } -> std::convertible_to<bool>;
+        { State::GAME_EXP_FACTOR } -> std::convertible_to<int>;
+        { State::NUM_ACTIONS } -> std::convertible_to<int>;
+        { State::MAX_GAME_LENGTH } -> std::convertible_to<int>;
+        { cs.get_turn() } -> std::convertible_to<int>;
+        { cs.is_game_over() } -> std::same_as<bool>;
+        { cs.evaluate() } -> std::convertible_to<int>;
+        { cs.heuristic_value() } -> std::convertible_to<int>;
+        { cs.legal_moves() } -> std::same_as<std::vector<typename State::Move>>;
+        s.play(m);
+        s.unplay(m);
+        s.random_play();
+        s.mem_setup();
+        s.pass_turn();
+        s.unpass_turn();
+        s.reset();
+    };
+
+// OPTIONAL CAPABILITIES
+// a game opts into a fast path by providing the method, and the drivers pick it up with if constexpr.
+
+// plays random moves until the game ends, returning the winner as evaluate() would.
+template <class State>
+concept HasRolloutToEnd = requires(State s) {
+    { s.rollout_to_end() } -> std::convertible_to<int>;
+};
+
+// rollout_to_end(), but taking a winning move whenever there is one, and otherwise
+// blocking the opponent's, if they have one.
+template <class State>
+concept HasHeavyRollout = requires(State s) {
+    { s.heavy_rollout_to_end() } -> std::convertible_to<int>;
+};
+
+// plays State::BATCH_SIZE independent random playouts at once, returning every winner.
+template <class State>
+concept HasBatchRollout = requires(const State cs) {
+    { cs.rollout_batch() } -> std::same_as<std::array<int, State::BATCH_SIZE>>;
+};
+
+// a hash of the position, suitable for keying transposition tables.
+template <class State>
+concept HasHash = requires(const State cs) {
+    { cs.hash() } -> std::convertible_to<uint64_t>;
+};
+
+// the size of legal_moves() without building the vector.
+template <class State>
+concept HasNumLegalMoves = requires(const State cs) {
+    { cs.num_legal_moves() } -> std::convertible_to<size_t>;
+};
+
+// a hash of the position as seen through each of its symmetries (0 being the identity),
+// and where a move goes under each. see utilities/symmetry.hpp for the canonical forms.
+template <class State>
+concept HasSymmetries = HasHash<State> && requires(const State cs, typename State::Move m, int sym) {
+    { State::NUM_SYMMETRIES } -> std::convertible_to<int>;
+    { cs.symmetric_hash(sym) } -> std::convertible_to<uint64_t>;
+    { State::transform_move(m, sym) } -> std::convertible_to<typename State::Move>;
+    { State::inverse_symmetry(sym) } -> std::convertible_to<int>;
+};
+
+// the i-th element of legal_moves() without building the vector.
+template <class State>
+concept HasNthLegalMove = HasNumLegalMoves<State> && requires(const State cs, size_t i) {
+    { cs.nth_legal_move(i) } -> std::convertible_to<typename State::Move>;
+};
+
+// the game-theoretic value (as evaluate() gives it) and a move achieving it, from a solved table.
+template <class State>
+concept HasSolvedTable = requires(const State cs) {
+    { cs.solved_value() } -> std::convertible_to<int>;
+    { cs.solved_move() } -> std::convertible_to<typename State::Move>;
+};
+
+// the same as HasSolvedTable, but found by search. this may be slow, so drivers only use it when asked to.
+template <class State>
+concept HasExactSolver = requires(const State cs) {
+    { cs.solve() } -> std::same_as<std::pair<int, typename State::Move>>;
+};
+
+// whether the move just played completed a win for the side that played it.
+// this is cheaper than evaluate(), as only the last mover's pieces need checking.
+template <class State>
+concept HasLastMoveWon = requires(const State cs) {
+    { cs.last_move_won() } -> std::same_as<bool>;
+};
+
+// a fixed, search-independent preference between moves (higher is tried first).
+// alpha-beta uses it to break ties once the killer and history orderings have had their say.
+template <class State>
+concept HasStaticMoveOrder = requires(const State cs, typename State::Move m) {
+    { cs.static_move_score(m) } -> std::convertible_to<int>;
+};
+
+// a search over forcing moves only, for games where most wins are sequences of threats.
+// threat_search() returns a move that wins by force for the side to move, if it can prove one;
+// forced_replies() narrows the moves to those that might survive a threat the opponent
+// already has on the board, and is empty when there is no such threat.
+template <class State>
+concept HasThreatSearch = requires(const State cs) {
+    { cs.threat_search() } -> std::same_as<std::optional<typename State::Move>>;
+    { cs.forced_replies() } -> std::same_as<std::vector<typename State::Move>>;
+};
+
+// SELECTIVE SEARCH
+// Negamax only prunes and reduces unsoundly in games that opt in with these traits.
+
+// searching a pass at reduced depth is a safe lower bound (i.e. the game has no zugzwang).
+template <class State>
+concept UsesNullMovePruning = requires { requires State::NULL_MOVE_PRUNING; };
+
+// moves late in the ordering can be searched shallower, then re-searched if they surprise.
+template <class State>
+concept UsesLateMoveReductions = requires { requires State::LATE_MOVE_REDUCTIONS; };
+
+// near the leaves, moves can be skipped when heuristic_value() is this far (per ply) below alpha.
+template <class State>
+concept UsesFutilityPruning = requires {
+    { State::FUTILITY_MARGIN } -> std::convertible_to<int>;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "GameState.hpp"
+#include "utilities/symmetry.hpp"
+
+// the nodes of a Monte Carlo graph search: one per position rather than one per move
+// sequence, so that every move order reaching a position shares its statistics.
+// values follow lightvector's formulation: a node's value is the average of its own
+// playouts and of its children's values, each weighted by the visits of the edge to it,
+// so a child's visits through other parents don't skew this parent's average.
+namespace GraphNode {
+
+template <class Node, class Move>
+struct Edge {
+    // in the canonical frame of the position the edge leaves, for games with symmetries
+    Move move;
+    // set the first time the edge is taken
+    Node* child = nullptr;
+    int visits = 0;
+};
+
+template <class Move>
+class GraphNode {
+   public:
+    std::vector<Edge<GraphNode, Move>> edges;
+    // the value to the player who moved into this position, on TreeNode's winrate scale
+    double value = 0;
+    // the average result of the playouts run from this position itself
+    double utility = 0;
+    int playouts = 0;
+    // playouts plus the visits of every edge out
+    int visits = 0;
+    bool expanded = false;
+
+    // recomputes value from the playouts and the children, whose values are from the
+    // other player's point of view, out of win_score
+    void update_value(double win_score) {
+        double total = utility * playouts;
+        for (const auto& edge : edges) {
+            if (edge.visits) {
+                total += edge.visits * (win_score - edge.child->value);
+            }
+        }
+        value = total / visits;
+    }
+};
+
+template <GameState State>
+class Graph {
+    using Move = typename State::Move;
+
+   public:
+    using Node = GraphNode<Move>;
+
+   private:
+    // elements of an unordered_map never move, so nodes can point at each other
+    std::unordered_map<uint64_t, Node> nodes;
+
+   public:
+    // the key of a position, and the symmetry that takes it to the canonical frame
+    static auto key_of(const State& state) -> std::pair<uint64_t, int> {
+        if constexpr (HasSymmetries<State>) {
+            int sym = symmetry::canonical_symmetry(state);
+            return {state.symmetric_hash(sym), sym};
+        } else {
+            return {state.hash(), 0};
+        }
+    }
+
+    // a move in the position's own frame, from one in its canonical frame
+    static auto from_canonical(Move move, int sym) -> Move {
+        if constexpr (HasSymmetries<State>) {
+            return State::transform_move(move, State::inverse_symmetry(sym));
+        } else {
+            return move;
+        }
+    }
+
+    static auto to_canonical(Move move, int sym) -> Move {
+        if constexpr (HasSymmetries<State>) {
+            return State::transform_move(move, sym);
+        } else {
+            return move;
+        }
+    }
+
+    auto get_or_create(uint64_t key) -> Node& {
+        return nodes[key];
+    }
+
+    auto size() const -> size_t {
+        return nodes.size();
+    }
+
+    // an estimate of the memory held, in bytes: the map's nodes and buckets, and the edges
+    auto memory_usage() const -> size_t {
+        size_t out = nodes.bucket_count() * sizeof(void*);
+        for (const auto& [key, node] : nodes) {
+            out += sizeof(std::pair<const uint64_t, Node>) + sizeof(void*) + node.edges.capacity() * sizeof(Edge<Node, Move>);
+        }
+        return out;
+    }
+
+    void clear() {
+        nodes.clear();
+    }
+};
+
+}  // namespace GraphNode
@@ -24,6 +24,14 @@ class Istus {
         search_driver.set_depth_limit(x);
     }
 
+    void set_solver_mode(bool b) {
+        search_driver.set_solver_mode(b);
+    }
+
+    void set_threads(int n) {
+        search_driver.set_threads(n);
+    }
+
     void set_readout(bool b) {
         search_driver.set_readout(b);
     }
@@ -1,20 +1,40 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <concepts>
 #include <limits>
+#include <memory>
 #include <random>
+#include <utility>
 
+#include "CompactTree.hpp"
+#include "GameState.hpp"
+#include "GraphNode.hpp"
 #include "UCT.hpp"
 #include "TreeNode.hpp"
 
 constexpr auto INF = std::numeric_limits<int>::max();
 constexpr auto N_INF = -std::numeric_limits<int>::max();
 
-template <class State>
+template <GameState State>
 class MCTS {
    private:
+    using Move = typename State::Move;
     using Node = TreeNode::TreeNode<State>;
+    using Graph = GraphNode::Graph<State>;
+    using Position = typename Graph::Node;
     static constexpr auto WIN_SCORE = 10;
+    // how many iterations pass between reads of the clock
+    static constexpr auto CLOCK_INTERVAL = 16;
+    // a search that runs out of time with its runner-up within this share of the best
+    // move's visits may draw on the time banked by earlier searches, up to this share of
+    // the time limit
+    static constexpr auto CLOSE_VISIT_RATIO = 0.8;
+    static constexpr auto MAX_EXTENSION = 0.5;
     // limiter on search time
     long long time_limit;
     // limiter on rollouts
@@ -31,17 +51,79 @@ class MCTS {
     bool debug = false;
     bool limit_by_rollouts = true;
     bool limit_by_time = true;
+    // run a whole batch of playouts from each leaf, if the game supports it
+    bool batch_playouts = false;
+    // answer from the game's solved table instead of searching, if it has one
+    bool use_solved_table = true;
+    // settle forced wins and losses with the game's threat search, if it has one, when
+    // expanding nodes, and also in place of playouts (which costs far more iterations)
+    bool use_threat_search = true;
+    bool threat_playouts = false;
+    // play out with the game's heavy policy, if it has one, which takes wins and blocks
+    // the opponent's rather than moving at random
+    bool heavy_playouts = false;
+    // search a graph of positions, merging transpositions, instead of a tree of move
+    // sequences. this needs the game to have a hash.
+    bool graph_search = false;
+    Graph graph;
+    // search a tree of 16-byte nodes in one arena, replaying moves from the root rather
+    // than keeping a position in every node, and proving wins and losses as it goes.
+    // a node has at most 255 children, so this needs games with no more actions than that.
+    bool compact_tree = false;
+    CompactTree::Arena arena;
+    std::vector<uint32_t> compact_path;
+
+    // blend all-moves-as-first statistics into selection, with a weight that fades as
+    // β = sqrt(k / (3n + k)) for a child with n visits, k being the equivalence parameter
+    bool use_rave = false;
+    double rave_equivalence = 1000;
+    // progressive bias adds weight * h / (n + 1) to a child's UCB1, where h is how much its
+    // move gains on heuristic_value() for the side playing it. progressive widening only
+    // lets selection see the best 2 + N^exponent children of a node with N visits, taking
+    // them in heuristic order.
+    double progressive_bias = 0;
+    bool progressive_widening = false;
+    double widening_exponent = 0.5;
+    // heuristic_value() is read as a win probability through a logistic curve, so that a
+    // lead of heuristic_scale is worth a 73% chance to win
+    double heuristic_scale = 10;
+    // playouts stop after this many plies, or zero to play to the end, and a game still
+    // running is scored by the heuristic. cut-off playouts move at random, one move at a time.
+    int playout_cutoff = 0;
+    // implicit minimax backups: every node also holds the minimax value of the heuristic
+    // over its subtree, and selection blends this weight of it into the exploitation term
+    double implicit_minimax = 0;
+    // the most nodes the tree (or positions the graph) may hold, or zero for no limit.
+    // once it is full, the search either stops expanding and just runs more playouts from
+    // its leaves, or recycles the subtrees that have gone longest without a visit. only
+    // the tree can recycle: in the graph, positions are shared between parents.
+    size_t node_budget = 0;
+    bool recycle_nodes = false;
+    // recycling frees the stalest nodes until the tree is down to this fraction of the budget
+    static constexpr double RECYCLE_TARGET = 0.75;
+    size_t tree_size = 0;
+    // counts iterations across searches, to stamp the nodes each one passes through
+    int visit_clock = 0;
+    // keep the subtree of the chosen move after a search, so that the next search (or a
+    // ponder), if it starts from that position or one of its replies, begins with those
+    // statistics. this needs the game's positions to be comparable.
+    bool reuse_tree = false;
+    std::unique_ptr<Node> kept_tree;
+
+    // manage the time of searches limited by time: stop once the most-visited move can't
+    // be caught in the time left, or when there is nothing to decide, and bank the time
+    // saved, to spend on positions where the two best moves are close
+    bool time_management = true;
+    long long banked_ms = 0;
+    std::chrono::steady_clock::time_point search_start;
+    std::chrono::steady_clock::time_point search_end;
+    bool extended = false;
 
     // recorded search data
-    // std::array<int, State::NUM_UNIQUE_MOVES> amaf_counters;
     // the win / loss ratio of the most recently played move
     double last_winloss;
     int node_count;
 
-    // dictates whether we preserve a part of the tree across moves
-    // bool memsafe = true;
-    // Node* preservedNode = nullptr;
-
    public:
     MCTS() {
         MCTS(1, 3);
@@ -113,15 +195,136 @@ class MCTS {
         rollout_limit = rl;
     }
 
+    void set_batch_playouts(bool b) {
+        batch_playouts = b;
+    }
+
+    void set_use_solved_table(bool b) {
+        use_solved_table = b;
+    }
+
+    void set_use_threat_search(bool b) {
+        use_threat_search = b;
+    }
+
+    void set_threat_playouts(bool b) {
+        threat_playouts = b;
+    }
+
+    void set_heavy_playouts(bool b) {
+        heavy_playouts = b;
+    }
+
+    void set_graph_search(bool b) {
+        graph_search = b;
+    }
+
+    void set_compact_tree(bool b) {
+        compact_tree = b;
+    }
+
+    void set_rave(bool b) {
+        use_rave = b;
+    }
+
+    void set_rave_equivalence(double k) {
+        rave_equivalence = k;
+    }
+
+    void set_progressive_bias(double weight) {
+        progressive_bias = weight;
+    }
+
+    void set_progressive_widening(bool b) {
+        progressive_widening = b;
+    }
+
+    void set_widening_exponent(double x) {
+        widening_exponent = x;
+    }
+
+    void set_heuristic_scale(double x) {
+        heuristic_scale = x;
+    }
+
+    void set_playout_cutoff(int plies) {
+        playout_cutoff = plies;
+    }
+
+    void set_implicit_minimax(double weight) {
+        implicit_minimax = weight;
+    }
+
+    void set_node_budget(size_t n) {
+        node_budget = n;
+    }
+
+    void set_recycle_nodes(bool b) {
+        recycle_nodes = b;
+    }
+
+    void set_time_management(bool b) {
+        time_management = b;
+        banked_ms = 0;
+    }
+
+    void set_reuse_tree(bool b) {
+        reuse_tree = b;
+        if (!b) {
+            kept_tree.reset();
+        }
+    }
+
     // GETTERS
     auto get_nodes() const -> int {
         return node_count;
     }
 
+    auto get_node_budget() const -> size_t {
+        return node_budget;
+    }
+
+    // how many tree nodes fit in the given number of bytes, by the estimate of get_memory_usage()
+    static constexpr auto nodes_in_memory(size_t bytes) -> size_t {
+        return bytes / (sizeof(Node) + sizeof(Node*));
+    }
+
+    // the nodes in the tree (or positions in the graph) built by the last search
+    auto get_tree_size() const -> size_t {
+        if (compact_tree) {
+            return arena.size();
+        }
+        if constexpr (HasHash<State>) {
+            if (graph_search) {
+                return graph.size();
+            }
+        }
+        return tree_size;
+    }
+
+    // an estimate of the memory the tree (or graph) of the last search holds, in bytes
+    auto get_memory_usage() const -> size_t {
+        if (compact_tree) {
+            return arena.memory_usage();
+        }
+        if constexpr (HasHash<State>) {
+            if (graph_search) {
+                return graph.memory_usage();
+            }
+        }
+        return tree_size * (sizeof(Node) + sizeof(Node*));
+    }
+
     auto get_most_recent_winrate() const -> double {
         return last_winloss;
     }
 
+    // when the time for the last search's move runs out, extensions included, so that
+    // other work on the same move can stay inside it. searches limited by rollouts have none.
+    auto get_move_deadline() const -> std::chrono::steady_clock::time_point {
+        return limit_by_time ? search_end : std::chrono::steady_clock::time_point::max();
+    }
+
     // auto prune(Node* parent, const State& target) -> Node* {
     //     Node* out = nullptr;
     //     bool found = false;
@@ -143,36 +346,119 @@ class MCTS {
 
         node_count = 0;
 
+        if constexpr (HasSolvedTable<State>) {
+            if (use_solved_table) {
+                State out = board;
+                out.play(board.solved_move());
+                // a won position scores WIN_SCORE, the same scale as a node's winrate
+                last_winloss = (board.solved_value() * board.get_turn() + 1) * WIN_SCORE / 2.0;
+                if (readout) {
+                    std::cout << "solved position, value: " << board.solved_value() << "\n";
+                }
+                return out;
+            }
+        }
+
+        if constexpr (HasHash<State>) {
+            if (graph_search) {
+                return find_best_next_board_graph(board);
+            }
+        }
+
+        if constexpr (State::NUM_ACTIONS <= 255) {
+            if (compact_tree) {
+                return find_best_next_board_compact(board);
+            }
+        }
+
         // tracks time
-        auto start = std::chrono::steady_clock::now();
-        auto end = start + std::chrono::milliseconds(time_limit);
+        start_clock();
+        auto start = search_start;
 
-        auto root_node = Node(board);
+        auto root_node = take_kept_tree(board);
+        int reused_visits = root_node->get_visit_count();
+        bool decided = false;
 
         assert(limit_by_rollouts != limit_by_time);
         do {
-            select_expand_simulate_backpropagate(&root_node);
+            select_expand_simulate_backpropagate(root_node.get());
             node_count++;
+            if (node_count == 1) {
+                decided = nothing_to_decide(root_node.get());
+            }
             // root_node.show();
             // show_debug(&root_node);
             // show_pv(&root_node);
-        } while (
-            (!limit_by_time || std::chrono::steady_clock::now() < end) && (!limit_by_rollouts || node_count < rollout_limit));
+        } while (keep_searching(root_node.get(), decided));
+        stop_clock();
 
-        State out = root_node.best_child()->get_state();
+        Node* best = root_node->best_child();
+        State out = best->get_state();
+        last_winloss = best->get_winrate();
 
         if (readout) {
             auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
             std::cout << node_count << " nodes processed in " << time << "ms at " << (double)node_count / ((double)time / 1000.0) << "NPS.\n";
-            std::cout << "predicted winrate: " << root_node.best_child()->get_winrate() << "\n";
+            if (reused_visits) {
+                std::cout << reused_visits << " visits reused from earlier searches\n";
+            }
+            std::cout << "predicted winrate: " << best->get_winrate() << "\n";
+            std::cout << tree_size << " nodes in the tree, using " << get_memory_usage() / (1024 * 1024) << "MB\n";
+            if (limit_by_time && time_management) {
+                std::cout << banked_ms << "ms banked for later moves\n";
+            }
         }
-        
+
+        if (reuse_tree) {
+            tree_size = 1 + best->subtree_size();
+            kept_tree.reset(root_node->detach_child(best));
+        }
+
         // root_node.print_pv();
         // root_node.print_tree();
         return out;
     }
 
-    auto get_rollout_counts(const State board) -> std::vector<int> {
+    // searches from board until stop is set, keeping the tree for the next search. run on a
+    // thread of its own while the opponent thinks, it leaves the tree rooted at board, so
+    // that the search for our next move starts from the subtree of the reply they chose.
+    void ponder(const State& board, const std::atomic<bool>& stop) {
+        node_count = 0;
+        auto root_node = take_kept_tree(board);
+        while (!board.is_game_over() && !stop.load(std::memory_order_relaxed)) {
+            select_expand_simulate_backpropagate(root_node.get());
+            node_count++;
+        }
+        kept_tree = std::move(root_node);
+    }
+
+    // the root of a search from board: the kept tree, or the child of its root that holds
+    // board, if either does, and otherwise a new tree
+    auto take_kept_tree(const State& board) -> std::unique_ptr<Node> {
+        if constexpr (std::equality_comparable<State>) {
+            if (reuse_tree && kept_tree) {
+                if (kept_tree->get_state() == board) {
+                    tree_size = 1 + kept_tree->subtree_size();
+                    return std::move(kept_tree);
+                }
+                for (Node* child : kept_tree->get_children()) {
+                    if (child->get_state() == board) {
+                        auto out = std::unique_ptr<Node>(kept_tree->detach_child(child));
+                        kept_tree.reset();
+                        tree_size = 1 + out->subtree_size();
+                        return out;
+                    }
+                }
+            }
+        }
+        kept_tree.reset();
+        tree_size = 1;
+        return std::make_unique<Node>(board);
+    }
+
+    // the visits of each move searched from board. the root's children aren't in the order of
+    // legal_moves() once they have been sorted by the heuristic or narrowed by the threat search.
+    auto get_rollout_counts(const State board) -> std::vector<std::pair<Move, int>> {
         // board is immediately copied  ^^^
 
         node_count = 0;
@@ -182,6 +468,7 @@ class MCTS {
         auto end = start + std::chrono::milliseconds(time_limit);
 
         Node* root_node = new Node(board);
+        tree_size = 1;
 
         // assert(limit_by_rollouts != limit_by_time);
         do {
@@ -200,29 +487,145 @@ class MCTS {
         last_winloss = root_node->best_child()->get_winrate();
         last_winloss = std::max(last_winloss, 0.0);
 
-        int len = root_node->get_children().size();
-        std::vector<int> out(len);
-        for (int child_idx = 0; child_idx < len; child_idx++) {
-            out[child_idx] = root_node->get_children()[child_idx]->get_visit_count();
+        std::vector<std::pair<Move, int>> out;
+        out.reserve(root_node->get_children().size());
+        for (const Node* child : root_node->get_children()) {
+            out.emplace_back(child->get_move(), child->get_visit_count());
         }
 
         delete root_node;
         return out;
     }
 
+    // TIME MANAGEMENT
+    void start_clock() {
+        search_start = std::chrono::steady_clock::now();
+        search_end = search_start + std::chrono::milliseconds(time_limit);
+        extended = false;
+    }
+
+    // banks whatever the search saved on its time limit, less whatever it overran by
+    void stop_clock() {
+        if (limit_by_time && time_management) {
+            auto used = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - search_start).count();
+            banked_ms = std::max(0LL, banked_ms + time_limit - used);
+        }
+    }
+
+    // takes time spent on the move after the search, out of what the search banked
+    void charge_time(long long ms) {
+        if (limit_by_time && time_management) {
+            banked_ms = std::max(0LL, banked_ms - ms);
+        }
+    }
+
+    // whether the root has a single move, or one that wins on the spot
+    auto nothing_to_decide(Node* root_node) const -> bool {
+        const auto& children = root_node->get_children();
+        if (children.size() == 1) {
+            return true;
+        }
+        int mover = root_node->get_state().get_turn();
+        return std::any_of(children.begin(), children.end(), [mover](Node* child) {
+            return child->get_state().is_game_over() && child->get_state().evaluate() == mover;
+        });
+    }
+
+    auto keep_searching(const Node* root_node, bool decided) -> bool {
+        if (limit_by_rollouts && node_count >= rollout_limit) {
+            return false;
+        }
+        if (!limit_by_time || node_count % CLOCK_INTERVAL) {
+            return true;
+        }
+        int best = 0, second = 0;
+        for (const Node* child : root_node->get_children()) {
+            int visits = child->get_visit_count();
+            if (visits > best) {
+                second = best;
+                best = visits;
+            } else if (visits > second) {
+                second = visits;
+            }
+        }
+        return !out_of_time(best, second, decided);
+    }
+
+    // whether a search limited by time should stop, given the visits of the root's two
+    // most-visited moves. without time management, it stops at the time limit.
+    auto out_of_time(int best, int second, bool decided) -> bool {
+        auto now = std::chrono::steady_clock::now();
+        if (!time_management) {
+            return now >= search_end;
+        }
+        if (decided) {
+            return true;
+        }
+        if (now >= search_end) {
+            // a close call gets one extension, out of the bank
+            if (!extended && second >= best * CLOSE_VISIT_RATIO) {
+                long long extension = std::min<long long>(banked_ms, time_limit * MAX_EXTENSION);
+                extended = true;
+                if (extension > 0) {
+                    search_end += std::chrono::milliseconds(extension);
+                    return false;
+                }
+            }
+            return true;
+        }
+        // the iterations left, at the rate so far, and whether they could all go to the runner-up
+        double elapsed = std::chrono::duration<double>(now - search_start).count();
+        double remaining = std::chrono::duration<double>(search_end - now).count();
+        return elapsed > 0 && best - second > node_count * remaining / elapsed;
+    }
+
     void select_expand_simulate_backpropagate(Node* root_node) {
+        visit_clock++;
         // SELECTION
         Node* promisingNode = select_promising_node(root_node);
 
         // EXPANSION
-        if (!promisingNode->get_state().is_game_over()) {
-            promisingNode->expand();
+        if (!promisingNode->get_state().is_game_over() && make_room(root_node, promisingNode)) {
+            expand_node(promisingNode);
+            tree_size += promisingNode->get_children().size();
         }
 
         Node* nodeToExplore = promisingNode;
 
         if (!promisingNode->get_children().empty()) {
-            nodeToExplore = promisingNode->random_child();
+            // only from the children that widening has unlocked, so the heuristic order holds
+            nodeToExplore = promisingNode->get_children()[rng::random_int(widened_width(promisingNode))];
+        }
+
+        if constexpr (HasBatchRollout<State>) {
+            if (batch_playouts) {
+                // SIMULATION
+                auto winning_sides = simulate_playout_batch(nodeToExplore);
+
+                // BACKPROPAGATION
+                backprop_batch(nodeToExplore, winning_sides);
+                return;
+            }
+        }
+
+        if (playout_cutoff) {
+            // SIMULATION
+            double x_share = simulate_playout_cutoff(nodeToExplore);
+
+            // BACKPROPAGATION
+            backprop_share(nodeToExplore, x_share);
+            return;
+        }
+
+        if (use_rave) {
+            // SIMULATION
+            Played played = {};
+            int winning_side = simulate_playout(nodeToExplore, &played);
+
+            // BACKPROPAGATION
+            backprop(nodeToExplore, winning_side);
+            backprop_amaf(nodeToExplore, winning_side, played);
+            return;
         }
 
         // SIMULATION
@@ -232,6 +635,64 @@ class MCTS {
         backprop(nodeToExplore, winning_side);
     }
 
+    void expand_node(Node* node) {
+        node->expand(moves_to_expand(node->get_state()));
+        bool ordered = progressive_bias != 0 || progressive_widening;
+        if (!ordered && implicit_minimax == 0) {
+            return;
+        }
+        int base = node->get_state().heuristic_value();
+        for (Node* child : node->get_children()) {
+            int h = child->get_state().heuristic_value();
+            child->set_heuristic(child->get_player_no() * (h - base));
+            child->set_implicit_value(child->get_player_no() == 1 ? win_probability(h) : 1 - win_probability(h));
+        }
+        if (ordered) {
+            // the best moves by the heuristic come first, which is the order widening unlocks them in
+            node->sort_children_by_heuristic();
+        }
+        if (implicit_minimax != 0) {
+            backup_implicit_values(node);
+        }
+    }
+
+    // X's chance to win, by the heuristic
+    auto win_probability(int heuristic) const -> float {
+        return 1.0f / (1.0f + std::exp(-(float)(heuristic / heuristic_scale)));
+    }
+
+    // each node's implicit value is the complement of its best child's, as the side to move
+    // there takes the child best for them. only the path up from a changed node can change.
+    void backup_implicit_values(Node* node) {
+        for (; node != nullptr; node = node->get_parent()) {
+            float best = 0;
+            for (const Node* child : node->get_children()) {
+                best = std::max(best, child->get_implicit_value());
+            }
+            if (node->get_implicit_value() == 1 - best) {
+                break;
+            }
+            node->set_implicit_value(1 - best);
+        }
+    }
+
+    auto moves_to_expand(const State& state) const -> std::vector<Move> {
+        if constexpr (HasThreatSearch<State>) {
+            if (use_threat_search) {
+                // a forced win only needs its first move searched, and a threat already on
+                // the board has to be answered, so the other moves aren't worth a node
+                if (auto win = state.threat_search()) {
+                    return {*win};
+                }
+                auto replies = state.forced_replies();
+                if (!replies.empty()) {
+                    return replies;
+                }
+            }
+        }
+        return state.legal_moves();
+    }
+
     auto relative_reward(int perspective, int reward) const -> int {
         // designed for two-player zero-sum environments.
         // my win == your loss
@@ -244,13 +705,122 @@ class MCTS {
 
     auto select_promising_node(Node* root_node) const -> Node* {
         Node* node = root_node;
+        node->set_last_visit(visit_clock);
         while (!node->get_children().empty()) {
-            node = UCT<Node, State::GAME_EXP_FACTOR>::best_child_ucb1(node);
+            node = best_child(node);
+            node->set_last_visit(visit_clock);
         }
         return node;
     }
 
-    auto simulate_playout(Node* node) -> int {
+    // whether there is room under the node budget to expand leaf, recycling old subtrees if allowed
+    auto make_room(Node* root_node, Node* leaf) -> bool {
+        if (!node_budget) {
+            return true;
+        }
+        size_t needed;
+        if constexpr (HasNumLegalMoves<State>) {
+            needed = leaf->get_state().num_legal_moves();
+        } else {
+            needed = leaf->get_state().legal_moves().size();
+        }
+        if (tree_size + needed <= node_budget) {
+            return true;
+        }
+        if (recycle_nodes) {
+            recycle(root_node, (size_t)(node_budget * RECYCLE_TARGET));
+        }
+        return tree_size + needed <= node_budget;
+    }
+
+    // collapses the subtrees that have gone longest without a visit until the tree is
+    // down to target nodes. a node is visited whenever any of its descendants is, so
+    // everything below a stale node is at least as stale, and collapsing every node last
+    // visited before some cutoff frees exactly the nodes whose parents are that stale.
+    // the root's children are kept, as the move is chosen from them.
+    void recycle(Node* root_node, size_t target) {
+        if (tree_size <= target) {
+            return;
+        }
+        std::vector<int> parent_visits;
+        parent_visits.reserve(tree_size);
+        for (const Node* child : root_node->get_children()) {
+            collect_parent_visits(child, parent_visits);
+        }
+        if (parent_visits.empty()) {
+            return;
+        }
+        size_t excess = std::min(tree_size - target, parent_visits.size());
+        std::nth_element(parent_visits.begin(), parent_visits.begin() + (excess - 1), parent_visits.end());
+        // the nodes on this iteration's path were all visited now, so they stay, along with
+        // the leaf about to be expanded, even if that leaves the tree over the target
+        int cutoff = std::min(parent_visits[excess - 1] + 1, visit_clock);
+        for (Node* child : root_node->get_children()) {
+            tree_size -= collapse_stale(child, cutoff);
+        }
+    }
+
+    void collect_parent_visits(const Node* node, std::vector<int>& out) const {
+        for (const Node* child : node->get_children()) {
+            out.push_back(node->get_last_visit());
+            collect_parent_visits(child, out);
+        }
+    }
+
+    auto collapse_stale(Node* node, int cutoff) -> size_t {
+        if (node->get_last_visit() < cutoff) {
+            return node->collapse();
+        }
+        size_t out = 0;
+        for (Node* child : node->get_children()) {
+            out += collapse_stale(child, cutoff);
+        }
+        return out;
+    }
+
+    // how many of node's children selection may choose between: all of them, or, with
+    // progressive widening, the best 2 + N^exponent for a node with N visits
+    auto widened_width(const Node* node) const -> size_t {
+        size_t width = node->get_children().size();
+        if (progressive_widening) {
+            width = std::min(width, 2 + (size_t)pow((double)node->get_visit_count(), widening_exponent));
+        }
+        return width;
+    }
+
+    auto best_child(const Node* node) const -> Node* {
+        using UCB = UCT<Node, State::GAME_EXP_FACTOR>;
+        const auto& children = node->get_children();
+        size_t width = widened_width(node);
+        if (!use_rave && progressive_bias == 0 && implicit_minimax == 0 && width == children.size()) {
+            return UCB::best_child_ucb1(node);
+        }
+        Node* best = children[0];
+        float best_value = -std::numeric_limits<float>::max();
+        float sqrt_log_parent = UCB::sqrt_log(node->get_visit_count());
+        for (size_t i = 0; i < width; i++) {
+            Node* child = children[i];
+            float value = use_rave
+                ? UCB::rave_value(sqrt_log_parent, child->get_win_score(), child->get_visit_count(), child->get_amaf_win_score(), child->get_amaf_visit_count(), rave_equivalence)
+                : UCB::fast_ucb1_value(sqrt_log_parent, child->get_win_score(), child->get_visit_count());
+            value += progressive_bias * child->get_heuristic() * UCB::reciprocal(child->get_visit_count() + 1);
+            if (implicit_minimax != 0 && child->get_visit_count()) {
+                // (1 - α) of the playouts' winrate plus α of the implicit value
+                float winrate = (float)child->get_win_score() * UCB::reciprocal(child->get_visit_count());
+                value += implicit_minimax * (WIN_SCORE * child->get_implicit_value() - winrate);
+            }
+            if (value > best_value) {
+                best_value = value;
+                best = child;
+            }
+        }
+        return best;
+    }
+
+    // the moves each side has played in a simulation (X's first), for AMAF
+    using Played = std::array<std::array<bool, State::NUM_ACTIONS>, 2>;
+
+    auto simulate_playout(Node* node, Played* played = nullptr) -> int {
         State playout_board = node->copy_state();
         playout_board.mem_setup();
 
@@ -266,18 +836,111 @@ class MCTS {
             return status;
         }
 
-        // play out until game over
-        while (!playout_board.is_game_over()) {
+        if (played) {
+            return playout_recording(playout_board, *played);
+        }
+        return playout(playout_board);
+    }
+
+    // X's share of a playout cut off after playout_cutoff plies: 1 for a win, 0 for a loss,
+    // a half for a draw, and the heuristic's win probability if the game is still running
+    auto simulate_playout_cutoff(Node* node) -> double {
+        State playout_board = node->copy_state();
+        playout_board.mem_setup();
+
+        // tests for an immediate loss in the position, as simulate_playout() does
+        int status = playout_board.evaluate();
+        if (status == -side) {
+            node->get_parent()->set_win_score(N_INF);
+            return (status + 1) / 2.0;
+        }
+
+        for (int ply = 0; ply < playout_cutoff && !playout_board.is_game_over(); ply++) {
             playout_board.random_play();
         }
+        if (playout_board.is_game_over()) {
+            return (playout_board.evaluate() + 1) / 2.0;
+        }
+        return win_probability(playout_board.heuristic_value());
+    }
+
+    // plays on at random like playout(), but one move at a time so that every move is recorded
+    auto playout_recording(State& playout_board, Played& played) const -> int {
+        while (!playout_board.is_game_over()) {
+            Move move;
+            if constexpr (HasNthLegalMove<State>) {
+                move = playout_board.nth_legal_move(rng::random_int(playout_board.num_legal_moves()));
+            } else {
+                move = rng::choice(playout_board.legal_moves());
+            }
+            played[playout_board.get_turn() == 1 ? 0 : 1][move] = true;
+            playout_board.play(move);
+        }
+        return playout_board.evaluate();
+    }
+
+    // the winner of a game played on from board, which may already be over
+    auto playout(State& playout_board) const -> int {
+        // a win that the threat search can prove needs no random playout to score
+        if constexpr (HasThreatSearch<State>) {
+            if (threat_playouts && !playout_board.is_game_over() && playout_board.threat_search()) {
+                return playout_board.get_turn();
+            }
+        }
+
+        if constexpr (HasHeavyRollout<State>) {
+            if (heavy_playouts) {
+                return playout_board.heavy_rollout_to_end();
+            }
+        }
+
+        // play out until game over
+        if constexpr (HasRolloutToEnd<State>) {
+            return playout_board.rollout_to_end();
+        } else {
+            while (!playout_board.is_game_over()) {
+                playout_board.random_play();
+            }
 
-        int winning_side = playout_board.evaluate();
+            int winning_side = playout_board.evaluate();
 
-        return winning_side;
+            return winning_side;
+        }
         // return (playout_board.evaluate() + 1) * 5;  // 1/0/-1 -> 10/5/0
         // return playout_board.evaluate() == side ? 10 : -10;  // 1/0/-1 -> 10/0/-10
     }
 
+    auto simulate_playout_batch(Node* node)
+        requires HasBatchRollout<State>
+    {
+        State playout_board = node->copy_state();
+        playout_board.mem_setup();
+
+        // tests for an immediate loss in the position
+        // and sets to N_INF if there is one.
+        int status = playout_board.evaluate();
+        assert(side != 0);
+        if (status == -side) {
+            node->get_parent()->set_win_score(N_INF);
+            decltype(playout_board.rollout_batch()) out;
+            out.fill(status);
+            return out;
+        }
+
+        return playout_board.rollout_batch();
+    }
+
+    template <size_t N>
+    void backprop_batch(Node* nodeToExplore, const std::array<int, N>& winning_sides) {
+        // tally the batch once, then apply all of it to every node on the path.
+        int x_wins = std::count(winning_sides.begin(), winning_sides.end(), 1);
+        int o_wins = std::count(winning_sides.begin(), winning_sides.end(), -1);
+        for (Node* bp_node = nodeToExplore; bp_node != nullptr; bp_node = bp_node->get_parent()) {
+            bp_node->add_visits(N);
+            bp_node->add_score(WIN_SCORE * (bp_node->get_player_no() == 1 ? x_wins : o_wins));
+        }
+    }
+
     void backprop(Node* nodeToExplore, int winning_side) {
         // works its way up the tree, adding relative scores to all the parent nodes.
         for (Node* bp_node = nodeToExplore; bp_node != nullptr; bp_node = bp_node->get_parent()) {
@@ -289,6 +952,349 @@ class MCTS {
         }
     }
 
+    // backprop() for a result shared between the sides, out of 1 for X
+    void backprop_share(Node* nodeToExplore, double x_share) {
+        int x_score = (int)std::lround(x_share * WIN_SCORE);
+        for (Node* bp_node = nodeToExplore; bp_node != nullptr; bp_node = bp_node->get_parent()) {
+            bp_node->increment_visits();
+            bp_node->add_score(bp_node->get_player_no() == 1 ? x_score : WIN_SCORE - x_score);
+        }
+    }
+
+    // updates the AMAF statistics of every child, along the path, whose move its side
+    // played at any later point in the simulation, in the tree or in the playout
+    void backprop_amaf(Node* nodeToExplore, int winning_side, Played& played) {
+        for (Node* bp_node = nodeToExplore; bp_node->get_parent() != nullptr; bp_node = bp_node->get_parent()) {
+            int mover = bp_node->get_player_no();
+            auto& moves = played[mover == 1 ? 0 : 1];
+            moves[bp_node->get_move()] = true;
+            for (Node* sibling : bp_node->get_parent()->get_children()) {
+                if (moves[sibling->get_move()]) {
+                    sibling->add_amaf(mover == winning_side ? WIN_SCORE : 0);
+                }
+            }
+        }
+    }
+
+    // GRAPH SEARCH
+    auto find_best_next_board_graph(const State& board) -> State
+        requires HasHash<State>
+    {
+        start_clock();
+        auto start = search_start;
+
+        graph.clear();
+        auto [root_key, root_sym] = graph.key_of(board);
+        Position& root = graph.get_or_create(root_key);
+
+        assert(limit_by_rollouts != limit_by_time);
+        while (true) {
+            select_expand_simulate_backpropagate_graph(board, root);
+            node_count++;
+            if (limit_by_rollouts && node_count >= rollout_limit) {
+                break;
+            }
+            if (limit_by_time && node_count % CLOCK_INTERVAL == 0) {
+                int best = 0, second = 0;
+                for (const auto& edge : root.edges) {
+                    if (edge.visits > best) {
+                        second = best;
+                        best = edge.visits;
+                    } else if (edge.visits > second) {
+                        second = edge.visits;
+                    }
+                }
+                if (out_of_time(best, second, root.edges.size() == 1)) {
+                    break;
+                }
+            }
+        }
+        stop_clock();
+
+        // the most-travelled edge, as the tree search takes the most-visited child
+        auto best = std::max_element(
+            root.edges.begin(), root.edges.end(),
+            [](const auto& a, const auto& b) { return a.visits < b.visits; });
+        State out = board;
+        out.play(graph.from_canonical(best->move, root_sym));
+        last_winloss = best->child ? best->child->value : 0;
+
+        if (readout) {
+            auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            std::cout << node_count << " nodes processed in " << time << "ms at " << (double)node_count / ((double)time / 1000.0) << "NPS.\n";
+            std::cout << graph.size() << " distinct positions\n";
+            std::cout << "predicted winrate: " << last_winloss << "\n";
+        }
+        return out;
+    }
+
+    void select_expand_simulate_backpropagate_graph(const State& board, Position& root)
+        requires HasHash<State>
+    {
+        using Edge = typename decltype(root.edges)::value_type;
+        State state = board;
+        std::vector<std::pair<Position*, Edge*>> path;
+        Position* node = &root;
+
+        // SELECTION
+        // descend until reaching a position that has never been visited, or a leaf
+        while (node->visits && node->expanded && !node->edges.empty()) {
+            Edge* edge = best_edge_ucb1(*node);
+            if (!edge->child && graph_full()) {
+                break;
+            }
+            int sym = graph.key_of(state).second;
+            state.play(graph.from_canonical(edge->move, sym));
+            if (!edge->child) {
+                edge->child = &graph.get_or_create(graph.key_of(state).first);
+            }
+            path.push_back({node, edge});
+            node = edge->child;
+        }
+
+        // EXPANSION
+        // as in the tree, a leaf is expanded on its second visit, then one of its moves is tried.
+        // a full graph stops adding positions, and its leaves just run more playouts
+        if (node->visits && !node->expanded && !graph_full() && !state.is_game_over()) {
+            int sym = graph.key_of(state).second;
+            for (auto move : moves_to_expand(state)) {
+                node->edges.push_back(Edge{graph.to_canonical(move, sym)});
+            }
+            node->expanded = true;
+            Edge* edge = &node->edges[rng::random_int(node->edges.size())];
+            state.play(graph.from_canonical(edge->move, sym));
+            edge->child = &graph.get_or_create(graph.key_of(state).first);
+            path.push_back({node, edge});
+            node = edge->child;
+        }
+
+        // SIMULATION
+        // draws score half a win, so that each side's values are the complement of the other's.
+        // the playout runs on state, so the leaf's mover is read before it does
+        int mover = -state.get_turn();
+        int winning_side = playout(state);
+        double result = winning_side == mover ? WIN_SCORE : winning_side == 0 ? WIN_SCORE / 2.0 : 0;
+
+        // BACKPROPAGATION
+        // only along the path taken: other parents of these positions see the change the
+        // next time they recompute their own value
+        node->utility += (result - node->utility) / ++node->playouts;
+        node->visits++;
+        node->update_value(WIN_SCORE);
+        for (auto it = path.rbegin(); it != path.rend(); ++it) {
+            auto [parent, edge] = *it;
+            edge->visits++;
+            parent->visits++;
+            parent->update_value(WIN_SCORE);
+        }
+    }
+
+    auto graph_full() const -> bool {
+        return node_budget && graph.size() >= node_budget;
+    }
+
+    // the edge maximising UCB1, with the child's shared value and the edge's own visits
+    auto best_edge_ucb1(Position& node) const {
+        using UCB = UCT<Node, State::GAME_EXP_FACTOR>;
+        auto* best = &node.edges[0];
+        float best_score = -1;
+        float sqrt_log_parent = UCB::sqrt_log(node.visits);
+        for (auto& edge : node.edges) {
+            if (!edge.visits) {
+                return &edge;
+            }
+            float score = edge.child->value + sqrt_log_parent * UCB::reciprocal_sqrt(edge.visits) * State::GAME_EXP_FACTOR;
+            if (score > best_score) {
+                best_score = score;
+                best = &edge;
+            }
+        }
+        return best;
+    }
+
+    // COMPACT TREE
+    auto find_best_next_board_compact(const State& board) -> State
+        requires(State::NUM_ACTIONS <= 255)
+    {
+        using CompactNode = CompactTree::Node;
+        start_clock();
+        auto start = search_start;
+
+        arena.clear();
+        if (node_budget) {
+            arena.reserve(node_budget);
+        }
+
+        assert(limit_by_rollouts != limit_by_time);
+        while (true) {
+            select_expand_simulate_backpropagate_compact(board);
+            node_count++;
+            const CompactNode& root = arena[CompactTree::Arena::ROOT];
+            // a proven root has nothing left to decide
+            if (root.is_proven() || (limit_by_rollouts && node_count >= rollout_limit)) {
+                break;
+            }
+            if (limit_by_time && node_count % CLOCK_INTERVAL == 0) {
+                int best = 0, second = 0;
+                for (uint32_t i = root.first_child; i < root.first_child + root.num_children; i++) {
+                    int visits = arena[i].visits;
+                    if (visits > best) {
+                        second = best;
+                        best = visits;
+                    } else if (visits > second) {
+                        second = visits;
+                    }
+                }
+                if (out_of_time(best, second, root.num_children == 1)) {
+                    break;
+                }
+            }
+        }
+        stop_clock();
+
+        // a proven win if there is one, else the most-visited move not proven lost
+        const CompactNode& root = arena[CompactTree::Arena::ROOT];
+        uint32_t best = root.first_child;
+        for (uint32_t i = root.first_child; i < root.first_child + root.num_children; i++) {
+            const CompactNode& child = arena[i];
+            if (child.has(CompactNode::PROVEN_WIN)) {
+                best = i;
+                break;
+            }
+            const CompactNode& incumbent = arena[best];
+            if (incumbent.has(CompactNode::PROVEN_LOSS) ? !child.has(CompactNode::PROVEN_LOSS) || child.visits > incumbent.visits
+                                                          : !child.has(CompactNode::PROVEN_LOSS) && child.visits > incumbent.visits) {
+                best = i;
+            }
+        }
+        const CompactNode& chosen = arena[best];
+        State out = board;
+        out.play(static_cast<Move>(chosen.move));
+        last_winloss = chosen.has(CompactNode::PROVEN_WIN) ? WIN_SCORE
+                     : chosen.has(CompactNode::PROVEN_LOSS) ? 0
+                     : chosen.visits ? WIN_SCORE * chosen.value / chosen.visits
+                     : WIN_SCORE / 2.0;
+
+        if (readout) {
+            auto time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            std::cout << node_count << " nodes processed in " << time << "ms at " << (double)node_count / ((double)time / 1000.0) << "NPS.\n";
+            if (root.is_proven()) {
+                std::cout << "proven " << (root.has(CompactNode::PROVEN_LOSS) ? "win" : "loss") << " for the side to move\n";
+            }
+            std::cout << "predicted winrate: " << last_winloss << "\n";
+            std::cout << arena.size() << " nodes in the arena, using " << arena.memory_usage() / (1024 * 1024) << "MB\n";
+        }
+        return out;
+    }
+
+    void select_expand_simulate_backpropagate_compact(const State& board) {
+        using CompactNode = CompactTree::Node;
+        State state = board;
+        compact_path.clear();
+        uint32_t idx = CompactTree::Arena::ROOT;
+        compact_path.push_back(idx);
+
+        // SELECTION
+        // a proven node needs no more search, and is scored like the end of the game
+        while (arena[idx].has(CompactNode::EXPANDED) && !arena[idx].is_proven()) {
+            idx = best_child_compact(idx);
+            state.play(static_cast<Move>(arena[idx].move));
+            compact_path.push_back(idx);
+        }
+
+        // the result for the player who moved into idx, or into the child tried from it
+        double result;
+        if (arena[idx].is_proven()) {
+            result = arena[idx].has(CompactNode::PROVEN_WIN) ? 1 : 0;
+        } else if (state.is_game_over()) {
+            int winner = state.evaluate();
+            int mover = -state.get_turn();
+            arena[idx].flags |= CompactNode::TERMINAL;
+            if (winner == mover) {
+                arena[idx].flags |= CompactNode::PROVEN_WIN;
+            } else if (winner == -mover) {
+                arena[idx].flags |= CompactNode::PROVEN_LOSS;
+            }
+            result = winner == mover ? 1 : winner == 0 ? 0.5 : 0;
+        } else {
+            // EXPANSION
+            auto moves = moves_to_expand(state);
+            if (!node_budget || arena.size() + moves.size() <= node_budget) {
+                arena.allocate(idx, moves);
+                idx = arena[idx].first_child + rng::random_int(moves.size());
+                state.play(static_cast<Move>(arena[idx].move));
+                compact_path.push_back(idx);
+            }
+
+            // SIMULATION
+            // the playout runs on state, so the mover is read before it does
+            int mover = -state.get_turn();
+            int winning_side = playout(state);
+            result = winning_side == mover ? 1 : winning_side == 0 ? 0.5 : 0;
+        }
+
+        // BACKPROPAGATION
+        bool proving = arena[idx].is_proven();
+        for (auto it = compact_path.rbegin(); it != compact_path.rend(); ++it) {
+            CompactNode& node = arena[*it];
+            node.visits++;
+            node.value += (float)result;
+            result = 1 - result;
+            // a proof goes up as far as it settles each parent
+            if (proving && it + 1 != compact_path.rend()) {
+                proving = update_proof(*(it + 1));
+            }
+        }
+    }
+
+    // settles the parent of a newly proven node, if it can: it is lost for the player who
+    // moved into it once any child wins, and won once every child loses
+    auto update_proof(uint32_t parent) -> bool {
+        using CompactNode = CompactTree::Node;
+        CompactNode& node = arena[parent];
+        if (node.is_proven()) {
+            return false;
+        }
+        bool all_lost = true;
+        for (uint32_t i = node.first_child; i < node.first_child + node.num_children; i++) {
+            if (arena[i].has(CompactNode::PROVEN_WIN)) {
+                node.flags |= CompactNode::PROVEN_LOSS;
+                return true;
+            }
+            all_lost &= arena[i].has(CompactNode::PROVEN_LOSS);
+        }
+        if (all_lost) {
+            node.flags |= CompactNode::PROVEN_WIN;
+        }
+        return all_lost;
+    }
+
+    // the child maximising UCB1, skipping children proven lost. the children of a node are
+    // contiguous, so this scans one block of the arena.
+    auto best_child_compact(uint32_t parent) const -> uint32_t {
+        using UCB = UCT<Node, State::GAME_EXP_FACTOR>;
+        using CompactNode = CompactTree::Node;
+        const CompactNode& node = arena[parent];
+        float sqrt_log_parent = UCB::sqrt_log(node.visits);
+        uint32_t best = node.first_child;
+        float best_value = -std::numeric_limits<float>::max();
+        for (uint32_t i = node.first_child; i < node.first_child + node.num_children; i++) {
+            const CompactNode& child = arena[i];
+            if (child.has(CompactNode::PROVEN_LOSS)) {
+                continue;
+            }
+            if (!child.visits || child.has(CompactNode::PROVEN_WIN)) {
+                return i;
+            }
+            float value = WIN_SCORE * child.value * UCB::reciprocal(child.visits) + sqrt_log_parent * UCB::reciprocal_sqrt(child.visits) * State::GAME_EXP_FACTOR;
+            if (value > best_value) {
+                best_value = value;
+                best = i;
+            }
+        }
+        return best;
+    }
+
     // DEBUG
     void show_debug(Node* root_node) const {
         if (debug && (node_count & 0b111111111111111) == 0b111111111111111) {
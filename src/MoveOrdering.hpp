@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <utility>
+#include <vector>
+
+#include "GameState.hpp"
+
+// orders moves for alpha-beta: the transposition table move first, then the
+// killer moves for this ply, then by history score (plus the static hook, if any).
+template <GameState State, int MAX_PLY>
+class MoveOrdering {
+    using Move = typename State::Move;
+    static constexpr auto TT_MOVE_SCORE = 1 << 30;
+    static constexpr auto KILLER_SCORE = 1 << 29;
+    static constexpr auto NUM_KILLERS = 2;
+
+    // quiet moves that caused a beta cutoff at each ply, most recent first
+    std::array<std::array<Move, NUM_KILLERS>, MAX_PLY> killers;
+    std::array<std::array<bool, NUM_KILLERS>, MAX_PLY> killer_set;
+    // how much each move has been worth, for each side to move
+    std::array<std::array<int, State::NUM_ACTIONS>, 2> history;
+
+   public:
+    MoveOrdering() {
+        clear();
+    }
+
+    void clear() {
+        for (auto& set : killer_set) {
+            set.fill(false);
+        }
+        for (auto& side : history) {
+            side.fill(0);
+        }
+    }
+
+    void order(std::vector<Move>& moves, const State& node, int ply, const Move* tt_move) const {
+        int side = node.get_turn() == 1 ? 0 : 1;
+        std::vector<std::pair<int, Move>> scored;
+        scored.reserve(moves.size());
+        for (auto move : moves) {
+            int score = history[side][move];
+            if constexpr (HasStaticMoveOrder<State>) {
+                score += node.static_move_score(move);
+            }
+            for (int k = 0; k < NUM_KILLERS; k++) {
+                if (killer_set[ply][k] && killers[ply][k] == move) {
+                    score = KILLER_SCORE - k;
+                }
+            }
+            if (tt_move && *tt_move == move) {
+                score = TT_MOVE_SCORE;
+            }
+            scored.emplace_back(score, move);
+        }
+        std::stable_sort(
+            scored.begin(), scored.end(),
+            [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (size_t i = 0; i < moves.size(); i++) {
+            moves[i] = scored[i].second;
+        }
+    }
+
+    void update_on_cutoff(const State& node, Move move, int ply, int depth) {
+        // shuffle the killers down, unless this move is already the first one
+        if (!(killer_set[ply][0] && killers[ply][0] == move)) {
+            for (int k = NUM_KILLERS - 1; k > 0; k--) {
+                killers[ply][k] = killers[ply][k - 1];
+                killer_set[ply][k] = killer_set[ply][k - 1];
+            }
+            killers[ply][0] = move;
+            killer_set[ply][0] = true;
+        }
+        // deeper cutoffs are worth more, and the scores are halved before they can overflow
+        int side = node.get_turn() == 1 ? 0 : 1;
+        history[side][move] += depth * depth;
+        if (history[side][move] > KILLER_SCORE / 2) {
+            for (auto& s : history) {
+                for (auto& h : s) {
+                    h /= 2;
+                }
+            }
+        }
+    }
+};
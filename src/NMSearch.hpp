@@ -1,40 +1,82 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
-template <class State>
+#include "GameState.hpp"
+#include "MoveOrdering.hpp"
+#include "TranspositionTable.hpp"
+#include "utilities/WorkStealingPool.hpp"
+
+template <GameState State>
 class Negamax {
    public:
     static constexpr auto MATE_SCORE = 100000;
     static constexpr auto INF = std::numeric_limits<int>::max();
     static constexpr auto N_INF = std::numeric_limits<int>::lowest() + 1;
     static constexpr auto MAX_DEPTH = 64;
+    // half-width of the first window tried around the previous iteration's score
+    static constexpr auto ASPIRATION_WINDOW = 25;
+    // iterative deepening starts no new depth once this share of the time limit is spent
+    static constexpr auto SOFT_LIMIT_PERCENT = 50;
+    // how many negamax calls pass between checks of the clock and the stop flag
+    static constexpr auto POLL_INTERVAL = 1024;
+    // null-move pruning searches the pass this much shallower than a real move
+    static constexpr auto NULL_MOVE_REDUCTION = 2;
+    // late-move reductions apply from this many moves into the ordering, at this depth or more
+    static constexpr auto LMR_MIN_MOVES = 3;
+    static constexpr auto LMR_MIN_DEPTH = 3;
+    // futility pruning applies at this depth or less
+    static constexpr auto FUTILITY_MAX_DEPTH = 2;
+    // the parallel solver only splits nodes shallower than this
+    static constexpr auto SPLIT_PLY = 8;
 
    private:
     using Move = typename State::Move;
+    using TT = TranspositionTable::TT<State>;
     // limiter on search time
     long long time_limit;
     // limiter on depth
     long long depth_limit;
-    // TT transpositionTable;
+    // number of threads searching in parallel (lazy SMP)
+    int threads = 1;
+    // shared by every thread of a search, along with the flag that stops the helpers.
+    // killer and history tables are per-thread, so that the helpers diverge.
+    std::shared_ptr<TT> tt = std::make_shared<TT>();
+    std::shared_ptr<std::atomic<bool>> stop = std::make_shared<std::atomic<bool>>(false);
+    MoveOrdering<State, MAX_DEPTH> ordering;
+    // set once a search has seen the stop flag or passed the deadline, and is unwinding
+    bool aborted = false;
+    bool deadline_active = false;
+    std::chrono::steady_clock::time_point hard_deadline;
+    int poll_counter = 0;
 
     // flags
     bool readout = true;
     bool debug = true;
     bool limit_by_depth;
     bool limit_by_time;
+    // solve exactly with State::solve() instead of searching, where the game has a solver
+    bool solver_mode = false;
 
     // recorded search data
     int node_count;
+    // triangular PV table: row ply holds the best line found from that ply,
+    // starting at pv_index(ply) and pv_length[ply] moves long.
     static constexpr auto PV_LEN = (MAX_DEPTH * MAX_DEPTH + MAX_DEPTH) / 2;
     std::array<Move, PV_LEN> pv_array;
+    std::array<int, MAX_DEPTH + 1> pv_length;
+    // the PV of the last iteration that ran to completion
+    std::vector<Move> best_line;
 
    public:
-    Negamax() {
-        Negamax(99);
-    }
+    Negamax() : Negamax(99) {}
     Negamax(long long strength) {
         time_limit = strength;
         limit_by_depth = false;
@@ -69,55 +111,169 @@ class Negamax {
         depth_limit = dl;
     }
 
+    void set_solver_mode(bool b) {
+        solver_mode = b;
+    }
+
+    void set_threads(int n) {
+        threads = std::max(1, n);
+    }
+
     // GETTERS
     auto get_nodes() const -> int {
         return node_count;
     }
 
+    auto get_pv() const -> std::vector<Move> {
+        return best_line;
+    }
+
     // SEARCH FUNCTIONS
 
 
-    auto negamax(State &node, int depth, int colour, int a, int b) -> int {
+    // fail-soft principal variation search. ply is the distance from the root,
+    // for the killer and PV tables. allow_null is cleared under a null move, so that
+    // two passes can't cancel out.
+    auto negamax(State &node, int depth, int colour, int a, int b, int ply = 0, bool allow_null = true) -> int {
         // assert(colour == 1 || colour == -1);
         // assert(depth >= 0);
+        pv_length[ply] = 0;
+        if (++poll_counter >= POLL_INTERVAL) {
+            poll_counter = 0;
+            if (stop->load(std::memory_order_relaxed) ||
+                (deadline_active && std::chrono::steady_clock::now() >= hard_deadline)) {
+                aborted = true;
+            }
+        }
+        if (aborted) {
+            return 0;
+        }
 
+        if constexpr (HasLastMoveWon<State>) {
+            // colour is always the side to move, so a win for
+            // the last mover is a loss from our perspective.
+            if (node.last_move_won()) {
+                node_count++;
+                return -MATE_SCORE;
+            }
+        }
         if (depth <= 0 || node.is_game_over()) {
             node_count++;
             return colour * (node.evaluate() * MATE_SCORE + node.heuristic_value());
         }
+        int original_a = a;
+        Move tt_move{};
+        bool has_tt_move = false;
+        if constexpr (HasHash<State>) {
+            if (auto entry = tt->probe_hash(node)) {
+                // the root always searches, so that there is a PV to play
+                if (ply > 0 && TT::usable(*entry, depth, a, b)) {
+                    node_count++;
+                    return entry->score;
+                }
+                tt_move = entry->best_move;
+                has_tt_move = true;
+            }
+        }
         int score;
+        bool null_window = b - a == 1;
+        bool mate_bounds = a <= -MATE_SCORE / 2 || b >= MATE_SCORE / 2;
 
-        // // MAKE A NULL MOVE
-        // node.pass_turn();
-        // // PERFORM A LIMITED SEARCH
-        // score = -negamax(node, depth - 3, -colour, -b, -a);
-        // // UNMAKE NULL MOVE
-        // node.unpass_turn();
-        // a = std::max(a, score);
-        // if (a >= b) {
-        //     return a;
-        // }
+        if constexpr (UsesNullMovePruning<State>) {
+            // if passing still fails high, a real move would too (barring zugzwang)
+            if (allow_null && null_window && !mate_bounds && ply > 0 && depth > NULL_MOVE_REDUCTION &&
+                colour * node.heuristic_value() >= b) {
+                node.pass_turn();
+                score = -negamax(node, depth - 1 - NULL_MOVE_REDUCTION, -colour, -b, -b + 1, ply + 1, false);
+                node.unpass_turn();
+                if (aborted) {
+                    return 0;
+                }
+                if (score >= b) {
+                    return b;
+                }
+            }
+        }
 
-        for (auto move : node.legal_moves()) {
+        // near the leaves, a position too far below alpha is only searched for moves that end the game
+        // (the heuristic plus the margin bounds what any quiet move could score)
+        bool futile = false;
+        int futility_bound = N_INF;
+        if constexpr (UsesFutilityPruning<State>) {
+            futility_bound = colour * node.heuristic_value() + State::FUTILITY_MARGIN * depth;
+            futile = depth <= FUTILITY_MAX_DEPTH && !mate_bounds && futility_bound <= a;
+        }
+
+        auto moves = node.legal_moves();
+        ordering.order(moves, node, ply, has_tt_move ? &tt_move : nullptr);
+        int best_score = N_INF;
+        Move best_move = moves[0];
+        for (size_t i = 0; i < moves.size(); i++) {
+            auto move = moves[i];
             node.play(move);
-            score = -negamax(node, depth - 1, -colour, -b, -a);
+            if (i == 0) {
+                score = -negamax(node, depth - 1, -colour, -b, -a, ply + 1);
+            } else if (futile && !node.is_game_over()) {
+                node.unplay(move);
+                best_score = std::max(best_score, futility_bound);
+                continue;
+            } else {
+                // late moves are searched shallower first, as they are unlikely to be best
+                int reduction = 0;
+                if constexpr (UsesLateMoveReductions<State>) {
+                    if (i >= LMR_MIN_MOVES && depth >= LMR_MIN_DEPTH) {
+                        reduction = i >= 2 * LMR_MIN_MOVES && depth > LMR_MIN_DEPTH ? 2 : 1;
+                    }
+                }
+                // try to prove this move is no better than the PV with a null window,
+                // and only pay for a full search if that fails
+                score = -negamax(node, depth - 1 - reduction, -colour, -a - 1, -a, ply + 1);
+                if (reduction > 0 && score > a) {
+                    score = -negamax(node, depth - 1, -colour, -a - 1, -a, ply + 1);
+                }
+                if (score > a && score < b) {
+                    score = -negamax(node, depth - 1, -colour, -b, -a, ply + 1);
+                }
+            }
             node.unplay(move);
+            if (aborted) {
+                // the score is meaningless, so nothing may be learned from it
+                return 0;
+            }
 
+            if (score > best_score) {
+                best_score = score;
+                best_move = move;
+            }
             if (score >= b) {
                 // beta cutoff
-                return b;
+                ordering.update_on_cutoff(node, move, ply, depth);
+                break;
             }
             if (score > a) {
                 // move that raises alpha
                 a = score;
+                update_pv(ply, move);
             }
         }
-        return a;
+        if constexpr (HasHash<State>) {
+            auto type = best_score >= b          ? TranspositionTable::LOWER
+                        : best_score <= original_a ? TranspositionTable::UPPER
+                                                   : TranspositionTable::EXACT;
+            tt->record_hash(node, depth, best_score, type, best_move);
+        }
+        return best_score;
     }
 
     auto dnegamax(State &node, int colour, int a = N_INF, int b = INF) -> int {
         // assert(colour == 1 || colour == -1);
 
+        if constexpr (HasLastMoveWon<State>) {
+            if (node.last_move_won()) {
+                node_count++;
+                return -1;
+            }
+        }
         if (node.is_game_over()) {
             node_count++;
             return colour * node.evaluate();
@@ -140,13 +296,31 @@ class Negamax {
 
     auto find_best_next_board(State node) -> State {
         reset_nodes();
-        Move bestmove = 0; // valid but will always be changed by minimax
+        best_line.clear();
+        Move bestmove = node.legal_moves()[0];  // only played if the search can't finish a single move
         int bestcase = N_INF;
 
-        if constexpr (State::GAME_SOLVABLE) {
-            unlimited_depth_minimax(node);
+        if constexpr (HasSolvedTable<State>) {
+            // the whole game is tabulated, so there is nothing to search
+            bestmove = node.solved_move();
+            bestcase = node.solved_value() * node.get_turn();
+        } else if constexpr (State::GAME_SOLVABLE) {
+            bestmove = unlimited_depth_minimax(node, bestcase);
         } else {
-            iterative_deepening_minimax(node);
+            bool solved = false;
+            if constexpr (HasExactSolver<State>) {
+                if (solver_mode) {
+                    auto [value, move] = node.solve();
+                    bestmove = move;
+                    bestcase = value * node.get_turn();
+                    solved = true;
+                }
+            }
+            if (!solved) {
+                bestmove = iterative_deepening_minimax(node, bestcase);
+                // only proven results count towards the win prediction
+                bestcase /= MATE_SCORE;
+            }
         }
         show_search_result(bestmove, bestcase);
         node.play(bestmove);
@@ -156,44 +330,297 @@ class Negamax {
     void show_search_result(Move bestmove, int bestcase) const {
         std::cout << "ISTUS:\n";
         std::cout << node_count << " nodes processed.\n";
-        std::cout << "Best move found: " << bestmove << "\n";
-        std::cout << "PV: ";
-        // for (auto m : pv) std::cout << (int)(m + 1) << " ";
-        std::cout << "\n";
+        std::cout << "Best move found: " << (int)bestmove << "\n";
+        if (!best_line.empty()) {
+            std::cout << "PV: ";
+            show_pv();
+        }
         std::cout << "Istus win prediction: " << (int)((1 + bestcase) * (50)) << "%\n";
     }
 
-    auto iterative_deepening_minimax(State &node) -> Move {
-        auto end = std::chrono::steady_clock::now();
-        end += std::chrono::milliseconds(time_limit);
-        for (
-            int depth = 1; 
-            std::chrono::steady_clock::now() < end && depth < 22;
-            depth++) {
-            // principal_variation.clear();
-            // principal_variation.reserve(256);
+    // searches one depth deeper each time until out of time, reusing the previous
+    // iteration's score as the centre of an aspiration window. returns the PV move.
+    // the time limit is hard: an iteration still running when it expires is abandoned,
+    // and the result of the last one to complete is used. a new iteration is only
+    // started if it is predicted to finish in time, and never after the soft limit.
+    auto iterative_deepening_minimax(State &node, int &score) -> Move {
+        auto start_time = std::chrono::steady_clock::now();
+        hard_deadline = start_time + std::chrono::milliseconds(time_limit);
+        Move bestmove = node.legal_moves()[0];
+        best_line.clear();
+        int max_depth = limit_by_depth ? std::min<long long>(depth_limit, MAX_DEPTH - 1) : MAX_DEPTH - 1;
+
+        // lazy SMP: the helpers run the same search on their own copies of the engine,
+        // communicating only through the transposition table. odd helpers start a ply
+        // deeper, so that the threads are spread over two depths at once.
+        stop->store(false);
+        aborted = false;
+        deadline_active = false;
+        std::vector<Negamax> helpers(threads - 1, *this);
+        std::vector<std::thread> workers;
+        for (int i = 0; i < threads - 1; i++) {
+            // each helper gets its own copy of the position up front: the main thread
+            // plays and unplays moves on node while the helpers are starting up
+            workers.emplace_back([&helpers, copy = node, i]() mutable {
+                auto& helper = helpers[i];
+                int helper_score = N_INF;
+                for (int depth = 1 + (i + 1) % 2; depth < MAX_DEPTH - 1 && !helper.aborted; depth++) {
+                    helper_score = helper.aspiration_search(copy, depth, helper_score);
+                }
+            });
+        }
+
+        long long last_iteration_ms = 0;
+        long long prev_iteration_ms = 0;
+        for (int depth = 1; depth <= max_depth; depth++) {
+            auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start_time).count();
+            if (limit_by_time && depth > 1) {
+                // each iteration is assumed to grow by the same factor as the last did
+                double growth = prev_iteration_ms > 0 ? std::clamp((double)last_iteration_ms / prev_iteration_ms, 2.0, 8.0) : 4.0;
+                if (elapsed_ms >= time_limit * SOFT_LIMIT_PERCENT / 100 ||
+                    elapsed_ms + last_iteration_ms * growth > time_limit) {
+                    break;
+                }
+            }
             auto start = std::chrono::steady_clock::now();
-            int score = negamax(
-                node, 
-                depth, 
-                node.get_turn(), 
-                N_INF, 
-                INF);
-            std::cout << "depth: " << depth << " best move: " /*<< (int)principal_variation[0]*/ << " score: " << score << " in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms\n";
+            int iteration_score = aspiration_search(node, depth, score);
+            auto iteration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+            if (aborted) {
+                if (readout) {
+                    std::cout << "depth: " << depth << " abandoned after " << iteration_ms << "ms\n";
+                }
+                break;
+            }
+            // depth 1 always runs to completion, so that there is a move to fall back on
+            deadline_active = limit_by_time;
+            prev_iteration_ms = last_iteration_ms;
+            last_iteration_ms = iteration_ms;
+            score = iteration_score;
+            if (pv_length[0] > 0) {
+                bestmove = pv_array[0];
+                best_line.assign(pv_array.begin(), pv_array.begin() + pv_length[0]);
+            }
+            if (readout) {
+                std::cout << "depth: " << depth << " best move: " << (int)bestmove << " score: " << score << " in " << iteration_ms << "ms pv: ";
+                show_pv();
+            }
+        }
+        deadline_active = false;
+
+        stop->store(true);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        for (auto& helper : helpers) {
+            node_count += helper.node_count;
         }
-        // return principal_variation[0];
-        return 0;
+        return bestmove;
     }
 
-    auto unlimited_depth_minimax(State &node) -> Move {
-        // principal_variation.clear();
-        // principal_variation.reserve(256);
-        dnegamax(node, node.get_turn());
-        // return principal_variation[0];
-        return 0;
+    // a search at the given depth that starts with a narrow window around guess,
+    // widening whichever side the true score falls outside of until it lands inside.
+    auto aspiration_search(State &node, int depth, int guess) -> int {
+        if (depth == 1 || guess <= N_INF || guess >= INF) {
+            return negamax(node, depth, node.get_turn(), N_INF, INF);
+        }
+        long long delta = ASPIRATION_WINDOW;
+        int a = std::max<long long>(N_INF, (long long)guess - delta);
+        int b = std::min<long long>(INF, (long long)guess + delta);
+        while (true) {
+            int score = negamax(node, depth, node.get_turn(), a, b);
+            if (aborted || (score > a && score < b)) {
+                return score;
+            }
+            delta *= 4;
+            if (score <= a) {
+                a = delta > MATE_SCORE ? N_INF : std::max<long long>(N_INF, (long long)score - delta);
+            } else {
+                b = delta > MATE_SCORE ? INF : std::min<long long>(INF, (long long)score + delta);
+            }
+        }
+    }
+
+    // solves every child of the root exactly, returning the best move.
+    auto unlimited_depth_minimax(State &node, int &score) -> Move {
+        int colour = node.get_turn();
+        if (threads > 1) {
+            WorkStealingPool pool(threads);
+            std::atomic<long long> total_nodes = 0;
+            SolverContext ctx{&pool, &total_nodes, nullptr};
+            Move bestmove;
+            score = ybw_negamax(node, colour, N_INF, INF, 0, ctx, &bestmove);
+            node_count += total_nodes + ctx.nodes;
+            return bestmove;
+        }
+        auto moves = node.legal_moves();
+        Move bestmove = moves[0];
+        score = N_INF;
+        for (auto move : moves) {
+            node.play(move);
+            int child_score = -dnegamax(node, -colour, N_INF, -score);
+            node.unplay(move);
+            if (child_score > score) {
+                score = child_score;
+                bestmove = move;
+            }
+        }
+        return bestmove;
+    }
+
+    // YOUNG BROTHERS WAIT
+    // a node shallower than SPLIT_PLY searches its first child alone, and once that has
+    // set a bound the remaining siblings are searched in parallel as tasks on the pool.
+    // the siblings share the node's alpha, and a cutoff in any of them aborts the rest,
+    // along with everything they have split off in turn.
+    struct SplitPoint {
+        std::atomic<int> a;
+        const int b;
+        std::atomic<int> pending;
+        std::atomic<bool> cutoff = false;
+        const SplitPoint* parent;
+        // only tracked at the root
+        std::mutex best_lock;
+        Move best_move;
+        int best_score;
+
+        SplitPoint(int a, int b, int pending, const SplitPoint* parent)
+            : a(a), b(b), pending(pending), parent(parent) {}
+    };
+
+    // what each thread carries through a task: the split point it searches under,
+    // and its own node count, which is only added to the shared total at the end.
+    struct SolverContext {
+        WorkStealingPool* pool;
+        std::atomic<long long>* total_nodes;
+        const SplitPoint* split;
+        long long nodes = 0;
+        bool aborted = false;
+    };
+
+    static auto cut_off_above(const SplitPoint* split) -> bool {
+        for (; split; split = split->parent) {
+            if (split->cutoff.load(std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // dnegamax, sharing work with the other threads near the root.
+    // a search that has been aborted returns 0, and sets ctx.aborted.
+    static auto ybw_negamax(State &node, int colour, int a, int b, int ply, SolverContext &ctx, Move *best_move = nullptr) -> int {
+        if ((++ctx.nodes & 1023) == 0 && cut_off_above(ctx.split)) {
+            ctx.aborted = true;
+        }
+        if (ctx.aborted) {
+            return 0;
+        }
+        if constexpr (HasLastMoveWon<State>) {
+            if (node.last_move_won()) {
+                return -1;
+            }
+        }
+        if (node.is_game_over()) {
+            return colour * node.evaluate();
+        }
+
+        auto moves = node.legal_moves();
+        size_t first_parallel = ply < SPLIT_PLY ? 1 : moves.size();
+        // the eldest brother (or, below SPLIT_PLY, every brother) is searched serially
+        for (size_t i = 0; i < first_parallel; i++) {
+            node.play(moves[i]);
+            int score = -ybw_negamax(node, -colour, -b, -a, ply + 1, ctx);
+            node.unplay(moves[i]);
+            if (ctx.aborted) {
+                return 0;
+            }
+            if (score >= b) {
+                return b;
+            }
+            if (score > a || i == 0) {
+                a = std::max(a, score);
+                if (best_move) {
+                    *best_move = moves[i];
+                }
+            }
+        }
+        if (first_parallel >= moves.size()) {
+            return a;
+        }
+
+        SplitPoint split(a, b, moves.size() - first_parallel, ctx.split);
+        split.best_score = a;
+        for (size_t i = first_parallel; i < moves.size(); i++) {
+            auto child = node;
+            child.play(moves[i]);
+            ctx.pool->push([&split, child, move = moves[i], colour, ply, best_move, pool = ctx.pool, total_nodes = ctx.total_nodes]() mutable {
+                SolverContext task_ctx{pool, total_nodes, &split};
+                if (!cut_off_above(&split)) {
+                    int alpha = split.a.load();
+                    int score = -ybw_negamax(child, -colour, -split.b, -alpha, ply + 1, task_ctx);
+                    if (!task_ctx.aborted) {
+                        if (score >= split.b) {
+                            split.cutoff = true;
+                        } else if (score > alpha) {
+                            // raise the shared alpha, unless another sibling got there first
+                            while (score > alpha && !split.a.compare_exchange_weak(alpha, score)) {
+                            }
+                            if (best_move) {
+                                std::lock_guard guard(split.best_lock);
+                                if (score > split.best_score) {
+                                    split.best_score = score;
+                                    *best_move = move;
+                                }
+                            }
+                        }
+                    }
+                }
+                *total_nodes += task_ctx.nodes;
+                split.pending--;
+            });
+        }
+        // help out with whatever work there is while the younger brothers finish
+        while (split.pending > 0) {
+            if (!ctx.pool->run_one()) {
+                std::this_thread::yield();
+            }
+        }
+        if (cut_off_above(ctx.split)) {
+            ctx.aborted = true;
+            return 0;
+        }
+        return split.cutoff ? b : split.a.load();
+    }
+
+    void show_pv() const {
+        for (auto move : best_line) {
+            std::cout << (int)move << " ";
+        }
+        std::cout << "\n";
     }
 
     void reset_nodes() {
         node_count = 0;
     }
+
+    // row ply of the PV becomes move followed by row ply + 1
+    void update_pv(int ply, Move move) {
+        int row = pv_index(ply);
+        int child_row = pv_index(ply + 1);
+        pv_array[row] = move;
+        for (int i = 0; i < pv_length[ply + 1]; i++) {
+            pv_array[row + 1 + i] = pv_array[child_row + i];
+        }
+        pv_length[ply] = pv_length[ply + 1] + 1;
+    }
+
+    static constexpr auto pv_index(int ply) -> int {
+        return ply * MAX_DEPTH - ply * (ply - 1) / 2;
+    }
+
+    // forget everything learned from previous searches
+    void clear_tables() {
+        tt->clear();
+        ordering.clear();
+    }
 };
\ No newline at end of file
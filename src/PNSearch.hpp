@@ -0,0 +1,246 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+#include "GameState.hpp"
+#include "utilities/symmetry.hpp"
+
+// depth-first proof-number search (df-pn), after Nagai.
+// it proves or disproves that the side to move at the root (the attacker) can force a
+// win, and is at its best in narrow, forcing trees where alpha-beta drowns in the width
+// of the board. draws count as disproofs.
+// every node has a proof number (how many more leaves must be shown to be wins to prove
+// it) and a disproof number (likewise, to disprove it). the search always works on the
+// most-proving node, but gets there depth-first: each call is given thresholds on both
+// numbers and only returns once one is reached, so the path from the root is never
+// re-walked. the numbers live in a fixed-size table, which is all the memory it uses.
+template <GameState State>
+class DFPN {
+   public:
+    using Move = typename State::Move;
+    enum Result {
+        DISPROVEN = -1,
+        UNKNOWN,
+        PROVEN,
+    };
+    static constexpr uint32_t INF = 1 << 30;
+    // the 1+ε trick: the most-proving child may run until it is this much worse than its
+    // best sibling, rather than just one worse, which stops the search thrashing between
+    // children of nearly equal promise.
+    static constexpr double EPSILON = 0.25;
+    // how many nodes pass between checks of the clock, for proofs with a deadline
+    static constexpr long long CLOCK_INTERVAL = 256;
+
+   private:
+    struct Entry {
+        uint64_t key = 0;
+        uint32_t pn = 1;
+        uint32_t dn = 1;
+        // the nodes spent on this entry, so that replacement keeps the expensive ones
+        uint64_t work = 0;
+    };
+
+    // a child of the node being searched. terminal children are scored once, on
+    // expansion, and never enter the table.
+    struct Child {
+        Move move;
+        uint64_t key;
+        bool terminal;
+        uint32_t pn;
+        uint32_t dn;
+    };
+
+    // an entry's proof numbers are from the attacker's point of view,
+    // so its key is salted when the attacker is O
+    static constexpr uint64_t O_ATTACKER_SALT = 0x9E3779B97F4A7C15ULL;
+
+    std::vector<Entry> table;
+    uint64_t mask = 0;
+    size_t megabytes = 16;
+    int attacker = 1;
+    long long node_count = 0;
+    long long node_budget = 0;
+    std::chrono::steady_clock::time_point deadline;
+    bool timed_out = false;
+    long long next_clock_check = 0;
+    Move proof_move = 0;
+
+    auto key_of(const State& node) const -> uint64_t {
+        uint64_t key;
+        if constexpr (HasSymmetries<State>) {
+            key = symmetry::canonical_hash(node);
+        } else {
+            key = node.hash();
+        }
+        return attacker == 1 ? key : key ^ O_ATTACKER_SALT;
+    }
+
+    // entries go in buckets of two, so a position is in slot (key & mask) or its neighbour
+    auto probe(uint64_t key) const -> const Entry* {
+        const Entry* bucket = &table[key & mask & ~1ULL];
+        for (int i = 0; i < 2; i++) {
+            if (bucket[i].key == key) {
+                return &bucket[i];
+            }
+        }
+        return nullptr;
+    }
+
+    void store(uint64_t key, uint32_t pn, uint32_t dn, uint64_t work) {
+        Entry* bucket = &table[key & mask & ~1ULL];
+        Entry* slot = bucket[0].key == key || (bucket[1].key != key && bucket[0].work <= bucket[1].work) ? &bucket[0] : &bucket[1];
+        *slot = Entry{key, pn, dn, work};
+    }
+
+    auto numbers_of(const Child& child) const -> std::pair<uint32_t, uint32_t> {
+        if (child.terminal) {
+            return {child.pn, child.dn};
+        }
+        const Entry* entry = probe(child.key);
+        return entry ? std::pair{entry->pn, entry->dn} : std::pair{1U, 1U};
+    }
+
+    // searches until the node's φ reaches th_phi or its δ reaches th_delta. at a node where
+    // the attacker is to move, φ is the proof number and δ the disproof number; at the
+    // defender's nodes they swap. either way, φ is the smallest δ among the children and
+    // δ is the sum of the children's φ.
+    void mid(State& node, uint64_t key, uint32_t th_phi, uint32_t th_delta, int ply) {
+        node_count++;
+        long long start_count = node_count;
+        bool attacker_to_move = node.get_turn() == attacker;
+
+        std::vector<Child> children;
+        for (auto move : node.legal_moves()) {
+            node.play(move);
+            Child child = {move, key_of(node), false, 1, 1};
+            if (node.is_game_over()) {
+                bool won = node.evaluate() == attacker;
+                child = {move, child.key, true, won ? 0 : INF, won ? INF : 0};
+            }
+            node.unplay(move);
+            children.push_back(child);
+        }
+
+        uint32_t phi, delta;
+        while (true) {
+            // find the most-proving child, and the runner-up's δ
+            phi = INF;
+            uint64_t delta_sum = 0;
+            size_t best = 0;
+            uint32_t best_phi = 0;
+            uint32_t second_delta = INF;
+            for (size_t i = 0; i < children.size(); i++) {
+                auto [pn, dn] = numbers_of(children[i]);
+                // the child's φ and δ, where the other side is to move
+                uint32_t child_phi = attacker_to_move ? dn : pn;
+                uint32_t child_delta = attacker_to_move ? pn : dn;
+                delta_sum += child_phi;
+                if (child_delta < phi) {
+                    second_delta = phi;
+                    phi = child_delta;
+                    best = i;
+                    best_phi = child_phi;
+                } else if (child_delta < second_delta) {
+                    second_delta = child_delta;
+                }
+            }
+            delta = static_cast<uint32_t>(std::min<uint64_t>(delta_sum, INF));
+            if (phi >= th_phi || delta >= th_delta || out_of_budget()) {
+                if (ply == 0 && phi == 0) {
+                    proof_move = children[best].move;
+                }
+                break;
+            }
+
+            // the child may run until it stops being the most proving: until its δ passes
+            // the runner-up's (by a factor of 1+ε), or until its φ would take our δ past ours
+            uint64_t grown = static_cast<uint64_t>(std::ceil(second_delta * (1.0 + EPSILON)));
+            uint32_t child_th_delta = static_cast<uint32_t>(std::min<uint64_t>(th_phi, std::max<uint64_t>(second_delta + 1ULL, grown)));
+            uint32_t child_th_phi = static_cast<uint32_t>(std::min<uint64_t>(INF, uint64_t{th_delta} - delta + best_phi));
+            Child& child = children[best];
+            node.play(child.move);
+            mid(node, child.key, child_th_phi, child_th_delta, ply + 1);
+            node.unplay(child.move);
+        }
+
+        uint32_t pn = attacker_to_move ? phi : delta;
+        uint32_t dn = attacker_to_move ? delta : phi;
+        store(key, pn, dn, node_count - start_count + 1);
+    }
+
+    // whether the proof has spent its nodes or passed its deadline, which, once it has,
+    // stays passed, so that every level of the search unwinds
+    auto out_of_budget() -> bool {
+        if (node_count >= node_budget || timed_out) {
+            return true;
+        }
+        if (node_count >= next_clock_check) {
+            next_clock_check = node_count + CLOCK_INTERVAL;
+            timed_out = std::chrono::steady_clock::now() >= deadline;
+        }
+        return timed_out;
+    }
+
+   public:
+    DFPN() = default;
+    DFPN(size_t megabytes) : megabytes(megabytes) {}
+
+    // SETTERS
+    // the table is allocated on the first proof, so an unused prover costs nothing
+    void resize(size_t mb) {
+        megabytes = mb;
+        table.clear();
+    }
+
+    void clear() {
+        std::fill(table.begin(), table.end(), Entry{});
+    }
+
+    // GETTERS
+    auto get_nodes() const -> long long {
+        return node_count;
+    }
+
+    // whether the side to move can force a win from root, searching at most node_budget
+    // nodes and stopping at deadline, and the winning move if it can. the table is kept
+    // between calls, so repeated proofs along a game reuse the work of earlier ones.
+    auto prove(const State& root, long long budget,
+               std::chrono::steady_clock::time_point until = std::chrono::steady_clock::time_point::max()) -> std::pair<Result, Move> {
+        if (table.empty()) {
+            size_t entries = 2;
+            while (entries * 2 * sizeof(Entry) <= megabytes * 1024 * 1024) {
+                entries *= 2;
+            }
+            table.resize(entries);
+            mask = entries - 1;
+        }
+        node_count = 0;
+        node_budget = budget;
+        deadline = until;
+        timed_out = false;
+        next_clock_check = 0;
+        attacker = root.get_turn();
+        proof_move = 0;
+        if (root.is_game_over()) {
+            return {root.evaluate() == attacker ? PROVEN : DISPROVEN, proof_move};
+        }
+
+        State node = root;
+        uint64_t key = key_of(node);
+        mid(node, key, INF, INF, 0);
+        const Entry* entry = probe(key);
+        if (entry && entry->pn == 0) {
+            return {PROVEN, proof_move};
+        }
+        if (entry && entry->dn == 0) {
+            return {DISPROVEN, proof_move};
+        }
+        return {UNKNOWN, proof_move};
+    }
+};
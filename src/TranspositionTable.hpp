@@ -1,62 +1,132 @@
+#pragma once
+
 #include <stdint.h>
 
+#include <atomic>
 #include <optional>
-#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "GameState.hpp"
+#include "utilities/symmetry.hpp"
+
+namespace TranspositionTable {
 
+enum Bound : uint8_t {
+    EXACT,
+    LOWER,  // the score failed high, the true value is at least this
+    UPPER,  // the score failed low, the true value is at most this
+};
+
+template <class Move>
 struct TTEntry {
-    uint_fast8_t depth;
-    uint_fast16_t score;
-    uint_fast8_t type;
+    uint64_t key = 0;
+    int32_t score = 0;
+    int16_t depth = -1;
+    Bound type = EXACT;
+    Move best_move = 0;
+};
 
-    TTEntry(uint_fast8_t d, uint_fast16_t s, uint_fast8_t t) {
-        depth = d;
-        score = s;
-        type = t;
+// a fixed-size, always-replace table of search results, keyed by State::hash().
+// games with symmetries are keyed by their canonical hash instead, so that symmetric
+// positions share an entry, and best moves are stored in the canonical frame.
+// it is shared between search threads without locks: each entry is packed into one
+// word and stored as two relaxed atomics (key ^ data, data), so a torn write from a
+// racing thread fails the key check instead of returning another position's result.
+template <class State>
+class TT {
+    using Move = typename State::Move;
+    using Entry = TTEntry<Move>;
+
+    struct Slot {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> data;
+    };
+    std::vector<Slot> hashtable;
+    uint64_t mask;
+
+    // score in the low 32 bits, then depth + 1 (so that zero means empty), bound type, and move
+    static auto pack(int score, int depth, Bound type, Move best_move) -> uint64_t {
+        return static_cast<uint32_t>(score) |
+               static_cast<uint64_t>(static_cast<uint8_t>(depth + 1)) << 32 |
+               static_cast<uint64_t>(type) << 40 |
+               static_cast<uint64_t>(static_cast<uint16_t>(best_move)) << 48;
     }
-};
 
-namespace TranspositionTable {
-class __attribute__((unused)) TT {
-    std::unordered_map<unsigned long long, TTEntry> hashtable;
+    static auto unpack(uint64_t key, uint64_t data) -> Entry {
+        return Entry{
+            key,
+            static_cast<int32_t>(static_cast<uint32_t>(data)),
+            static_cast<int16_t>(((data >> 32) & 0xFF) - 1),
+            static_cast<Bound>((data >> 40) & 0xFF),
+            static_cast<Move>(data >> 48)};
+    }
 
-   public:
-    void record_hash(const State& target, int depth, int a, int hashDataType) {
-        unsigned long long key = target.generateKey();
-        if (hashtable.contains(key)) {
-            TTEntry entry = hashtable[key];
-            if (entry.depth >= depth) {
-                hashtable[key] = TTEntry(depth, a, hashDataType);
-            }
+    // the key of a position, and the symmetry that takes it to the canonical frame
+    static auto key_of(const State& target) -> std::pair<uint64_t, int> {
+        if constexpr (HasSymmetries<State>) {
+            int sym = symmetry::canonical_symmetry(target);
+            return {target.symmetric_hash(sym), sym};
         } else {
-            hashtable[key] = TTEntry(depth, a, hashDataType);
+            return {target.hash(), 0};
         }
     }
 
-    auto probe_hash(const State& target) -> std::optional<TTEntry> {
-        unsigned long long key = target.generateKey();
-        if (hashtable.contains(key)) {
-            return hashtable[key];
-        } else {
+   public:
+    TT(size_t megabytes = 16) {
+        resize(megabytes);
+    }
+
+    void resize(size_t megabytes) {
+        // round down to a power of two so that indexing is a mask
+        size_t num_entries = 1;
+        while (num_entries * 2 * sizeof(Slot) <= megabytes * 1024 * 1024) {
+            num_entries *= 2;
+        }
+        hashtable = std::vector<Slot>(num_entries);
+        mask = num_entries - 1;
+    }
+
+    void clear() {
+        for (auto& slot : hashtable) {
+            slot.check.store(0, std::memory_order_relaxed);
+            slot.data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record_hash(const State& target, int depth, int score, Bound type, Move best_move) {
+        auto [key, sym] = key_of(target);
+        if constexpr (HasSymmetries<State>) {
+            best_move = State::transform_move(best_move, sym);
+        }
+        uint64_t data = pack(score, depth, type, best_move);
+        auto& slot = hashtable[key & mask];
+        slot.check.store(key ^ data, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+    }
+
+    auto probe_hash(const State& target) const -> std::optional<Entry> {
+        auto [key, sym] = key_of(target);
+        const auto& slot = hashtable[key & mask];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if (data == 0 || (slot.check.load(std::memory_order_relaxed) ^ data) != key) {
             return std::nullopt;
         }
+        auto entry = unpack(key, data);
+        if constexpr (HasSymmetries<State>) {
+            entry.best_move = State::transform_move(entry.best_move, State::inverse_symmetry(sym));
+        }
+        return entry;
     }
 
-    auto probe_hash_value(const State& target, int depth, int a, int b, bool &validityFlag) -> int {
-        unsigned long long key = target.generateKey();
-        TTEntry entry = hashtable[key];
-        if (entry.depth >= depth) {
-            if (entry.type == 0) {
-                return entry.score;
-            }
-            if (entry.type == 1 && entry.score <= a) {
-                return a;
-            }
-            if (entry.type == 2 && entry.score >= b) {
-                return b;
-            }
+    // whether an entry's score can be returned as-is for a search with this depth and window
+    static auto usable(const Entry& entry, int depth, int a, int b) -> bool {
+        if (entry.depth < depth) {
+            return false;
         }
-        validityFlag = false;
-        return 0;
+        return entry.type == EXACT ||
+               (entry.type == LOWER && entry.score >= b) ||
+               (entry.type == UPPER && entry.score <= a);
     }
 };
 }  // namespace TranspositionTable
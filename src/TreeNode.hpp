@@ -4,6 +4,7 @@
 #include <chrono>
 #include <random>
 
+#include "GameState.hpp"
 #include "games/Connect4-4x4.hpp"
 #include "games/Connect4.hpp"
 // #include "games/Gomoku.hpp"
@@ -13,14 +14,27 @@
 
 namespace TreeNode {
 
-template <class State>
+template <GameState State>
     class TreeNode {
         using Move = typename State::Move;
         State board;
         std::vector<TreeNode*> children;
         TreeNode* parent = nullptr;
+        // the move that led here from the parent
+        Move move = 0;
         int win_count = 0;
         int visits = 0;
+        // all-moves-as-first statistics: the results of simulations in which this node's
+        // move was played by the same side at any point after the parent
+        int amaf_win_count = 0;
+        int amaf_visits = 0;
+        // how much this node's move gained on heuristic_value() for the side that played it
+        int heuristic = 0;
+        // the heuristic's minimax value of this node, as a win probability for the side that
+        // moved into it, for implicit minimax backups
+        float implicit_value = 0.5f;
+        // the last iteration to pass through this node, so that the stalest subtrees can be recycled
+        int last_visit = 0;
         int turn;
 
        public:
@@ -36,7 +50,7 @@ template <class State>
             }
         }
 
-        TreeNode(const State& board, TreeNode* parent, int turn) : board(board), parent(parent), turn(turn) {}
+        TreeNode(const State& board, TreeNode* parent, int turn, Move move) : board(board), parent(parent), move(move), turn(turn) {}
 
         // SETTERS
         void set_state(const State& board) {
@@ -55,6 +69,18 @@ template <class State>
             this->win_count = win_count;
         }
 
+        void set_heuristic(int h) {
+            heuristic = h;
+        }
+
+        void set_implicit_value(float v) {
+            implicit_value = v;
+        }
+
+        void set_last_visit(int iteration) {
+            last_visit = iteration;
+        }
+
         // GETTERS
         auto get_state() -> State& {
             return board;
@@ -72,6 +98,10 @@ template <class State>
             return parent;
         }
 
+        auto get_move() const -> Move {
+            return move;
+        }
+
         auto get_player_no() const -> int {
             return turn;
         }
@@ -88,6 +118,35 @@ template <class State>
             return visits;
         }
 
+        auto get_amaf_win_score() const -> int {
+            return amaf_win_count;
+        }
+
+        auto get_amaf_visit_count() const -> int {
+            return amaf_visits;
+        }
+
+        auto get_heuristic() const -> int {
+            return heuristic;
+        }
+
+        auto get_implicit_value() const -> float {
+            return implicit_value;
+        }
+
+        auto get_last_visit() const -> int {
+            return last_visit;
+        }
+
+        // the number of nodes below this one
+        auto subtree_size() const -> size_t {
+            size_t out = children.size();
+            for (const auto& child : children) {
+                out += child->subtree_size();
+            }
+            return out;
+        }
+
         auto get_winrate() const -> double {
             return (double)win_count / (double)visits;
         }
@@ -105,6 +164,34 @@ template <class State>
             ++visits;
         }
 
+        void add_visits(int n) {
+            visits += n;
+        }
+
+        void add_amaf(int score) {
+            amaf_win_count += score;
+            ++amaf_visits;
+        }
+
+        // deletes every node below this one, which keeps its own statistics and becomes a
+        // leaf again, and returns how many were deleted
+        auto collapse() -> size_t {
+            size_t out = subtree_size();
+            for (auto child : children) {
+                delete child;
+            }
+            children.clear();
+            children.shrink_to_fit();
+            return out;
+        }
+
+        // removes child from this node, handing it over as the root of its own tree
+        auto detach_child(TreeNode* child) -> TreeNode* {
+            children.erase(std::find(children.begin(), children.end(), child));
+            child->set_parent(nullptr);
+            return child;
+        }
+
         auto random_child() const -> TreeNode* {
             assert(!children.empty());
             return rng::choice(children);
@@ -113,13 +200,30 @@ template <class State>
         void expand() {
             assert(board.num_legal_moves() == board.legal_moves().size());
             children.reserve(board.num_legal_moves());
-            for (int move : board.legal_moves()) {
+            for (auto move : board.legal_moves()) {
                 board.play(move);
-                children.push_back(new TreeNode(board, this, get_opponent()));
+                children.push_back(new TreeNode(board, this, get_opponent(), move));
                 board.unplay(move);
             }
         }
 
+        // expands only the given moves, when the others are known not to matter
+        void expand(const std::vector<Move>& moves) {
+            children.reserve(moves.size());
+            for (auto move : moves) {
+                board.play(move);
+                children.push_back(new TreeNode(board, this, get_opponent(), move));
+                board.unplay(move);
+            }
+        }
+
+        // best first, keeping the move generator's order between equals
+        void sort_children_by_heuristic() {
+            std::stable_sort(
+                children.begin(), children.end(),
+                [](const TreeNode* a, const TreeNode* b) { return a->get_heuristic() > b->get_heuristic(); });
+        }
+
         auto best_child() const -> TreeNode* {
             auto max = std::max_element(
                 children.begin(), children.end(),
@@ -128,10 +232,7 @@ template <class State>
         }
 
         auto best_child_as_move() const -> Move {
-            auto result = std::max_element(
-                children.begin(), children.end(),
-                [](const TreeNode* a, const TreeNode* b) { return (a->get_visit_count() < b->get_visit_count()); });
-            return board.legal_moves()[std::distance(children.begin(), result)];
+            return best_child()->get_move();
         }
 
         // DEBUG
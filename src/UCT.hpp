@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include <cmath>
 #include <limits>
 
@@ -11,7 +12,43 @@
 
 template <class Node, int EXP_FACTOR>
 class UCT {
+    // 1 / n and 1 / sqrt(n) for small visit counts, so that selection needs no division or sqrt
+    static constexpr int TABLE_SIZE = 1 << 12;
+    template <class F>
+    static auto make_table(F f) -> std::array<float, TABLE_SIZE> {
+        std::array<float, TABLE_SIZE> out = {};
+        for (int n = 1; n < TABLE_SIZE; n++) {
+            out[n] = f((float)n);
+        }
+        return out;
+    }
+    static inline const auto RECIPROCALS = make_table([](float n) { return 1.0f / n; });
+    static inline const auto RECIPROCAL_SQRTS = make_table([](float n) { return 1.0f / std::sqrt(n); });
+
    public:
+    static auto reciprocal(int visits) -> float {
+        return visits < TABLE_SIZE ? RECIPROCALS[visits] : 1.0f / (float)visits;
+    }
+
+    static auto reciprocal_sqrt(int visits) -> float {
+        return visits < TABLE_SIZE ? RECIPROCAL_SQRTS[visits] : 1.0f / std::sqrt((float)visits);
+    }
+
+    // sqrt(log(N)) for a parent with N visits, which every child's exploration term shares
+    static auto sqrt_log(int parent_visits) -> float {
+        return std::sqrt(std::log((float)parent_visits));
+    }
+
+    // ucb1_value in single precision, which is plenty to rank children, given sqrt_log of
+    // the parent's visits. unvisited children still come first.
+    static auto fast_ucb1_value(float sqrt_log_parent, int win_count, int visits) -> float {
+        if (visits == 0) {
+            return std::numeric_limits<float>::max();
+        }
+        return (float)win_count * reciprocal(visits) + sqrt_log_parent * reciprocal_sqrt(visits) * EXP_FACTOR;
+    }
+
+    // the reference formula, in double precision
     static auto ucb1_value(int parent_visits, int win_count, int visits) -> double {
         if (visits == 0) {
             return std::numeric_limits<double>::max() - 1;
@@ -21,6 +58,20 @@ class UCT {
         return exploitation + exploration;
     }
 
+    // UCB1 with its exploitation term blended towards the AMAF winrate, by a weight β
+    // that fades from 1 to 0 as the child's own visits outnumber the equivalence parameter
+    static auto rave_value(float sqrt_log_parent, int win_count, int visits, int amaf_win_count, int amaf_visits, float equivalence) -> float {
+        if (visits == 0) {
+            return std::numeric_limits<float>::max();
+        }
+        float exploitation = (float)win_count * reciprocal(visits);
+        if (amaf_visits) {
+            float beta = std::sqrt(equivalence / (3.0f * (float)visits + equivalence));
+            exploitation = (1 - beta) * exploitation + beta * (float)amaf_win_count * reciprocal(amaf_visits);
+        }
+        return exploitation + sqrt_log_parent * reciprocal_sqrt(visits) * EXP_FACTOR;
+    }
+
     static auto compute_ucb1(const Node* a) -> double {
         return ucb1_value(
             a->get_parent_visits(),
@@ -39,10 +90,19 @@ class UCT {
                    b->get_visit_count());
     }
 
+    // the child with the highest UCB1 value, the first of them on ties
     static auto best_child_ucb1(const Node* node) -> Node* {
-        return *std::max_element(
-            node->get_children().begin(),
-            node->get_children().end(),
-            compare_ucb1);
+        const auto& children = node->get_children();
+        float sqrt_log_parent = sqrt_log(node->get_visit_count());
+        Node* best = children[0];
+        float best_value = -std::numeric_limits<float>::max();
+        for (Node* child : children) {
+            float value = fast_ucb1_value(sqrt_log_parent, child->get_win_score(), child->get_visit_count());
+            if (value > best_value) {
+                best_value = value;
+                best = child;
+            }
+        }
+        return best;
     }
 };
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "TreeNode.hpp"
+#include "UCT.hpp"
+#include "utilities/rng.hpp"
+
+// checks the fast UCB1 selection against the reference double-precision formula,
+// on parents with random child statistics, and times both.
+
+using State = UTTT::State;
+using Node = TreeNode::TreeNode<State>;
+using UCB = UCT<Node, State::GAME_EXP_FACTOR>;
+
+// the selection as it was: every comparison recomputes both children's values from scratch
+auto reference_best_child(const Node* node) -> Node* {
+    return *std::max_element(node->get_children().begin(), node->get_children().end(), UCB::compare_ucb1);
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc <= 2) {
+        std::cout << "Run with arg1: parents, arg2: selections per parent.\n";
+        return 0;
+    }
+
+    auto parents = atoi(argv[1]);
+    auto repeats = atoi(argv[2]);
+
+    std::vector<Node*> roots;
+    for (int i = 0; i < parents; i++) {
+        auto root = new Node(State());
+        root->expand();
+        // a spread of visit counts, from a handful to far past the reciprocal tables
+        int max_visits = 1 << rng::random_int(20);
+        int total = 0;
+        for (auto child : root->get_children()) {
+            int visits = 1 + rng::random_int(max_visits);
+            child->add_visits(visits);
+            child->add_score(10 * rng::random_int(visits + 1));
+            total += visits;
+        }
+        root->add_visits(total);
+        roots.push_back(root);
+    }
+
+    // the two agree unless the best children are within float precision of each other
+    int disagreements = 0;
+    double worst_gap = 0;
+    for (auto root : roots) {
+        Node* reference = reference_best_child(root);
+        Node* fast = UCB::best_child_ucb1(root);
+        if (reference != fast) {
+            disagreements++;
+            double gap = UCB::compute_ucb1(reference) - UCB::compute_ucb1(fast);
+            worst_gap = std::max(worst_gap, gap);
+        }
+    }
+    printf("%d/%d selections agree, worst value lost on disagreement: %g\n", parents - disagreements, parents, worst_gap);
+
+    long long checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        for (auto root : roots) {
+            checksum += reference_best_child(root)->get_visit_count();
+        }
+    }
+    auto mid = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; r++) {
+        for (auto root : roots) {
+            checksum -= UCB::best_child_ucb1(root)->get_visit_count();
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    auto reference_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(mid - start).count();
+    auto fast_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - mid).count();
+    double selections = (double)parents * repeats;
+    printf("reference: %.1fns per selection\n", reference_ns / selections);
+    printf("fast:      %.1fns per selection (%.2fx)\n", fast_ns / selections, (double)reference_ns / (double)fast_ns);
+    printf("checksum: %lld\n", checksum);
+
+    for (auto root : roots) {
+        delete root;
+    }
+    return 0;
+}
@@ -2,14 +2,18 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 // #include <execution>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include "utilities/rng.hpp"
 #include "MCSearch.hpp"
+#include "PNSearch.hpp"
 
 // Possible heuristic improvement: use a long search to generate MCTS values for each starting square, use them as a heuristic starter.
-// The RAVE approach makes this heuristic value = some sort of aggregate score of the move on parent nodes.
 // UCT becomes (simulation value / rollouts) + (heuristic value / rollouts) + (exploration factor)
 
 template <class State>
@@ -18,6 +22,23 @@ class Zero {
     MCTS<State> search_driver = MCTS<State>();
     State node = State();
     static constexpr double epsilon = 0.1;
+    bool readout = true;
+
+    // once the search's favourite reaches this winrate (out of 10, as MCTS reports it),
+    // df-pn tries to prove the win within a node budget, for games with a hash to key it on
+    DFPN<State> prover = DFPN<State>();
+    bool use_proof_search = true;
+    double proof_threshold = 9.0;
+    long long proof_node_budget = 100000;
+
+    // keep searching on a thread of its own after each move, while the opponent thinks.
+    // the search driver belongs to that thread until the engine's next move stops it.
+    // a ponder only ends when the opponent moves, so unless a node budget has been set,
+    // the tree is held to this much memory, recycling its stalest subtrees.
+    bool pondering = false;
+    static constexpr size_t PONDER_MEMORY = 512 * 1024 * 1024;
+    std::thread ponder_thread;
+    std::shared_ptr<std::atomic<bool>> stop_ponder = std::make_shared<std::atomic<bool>>(false);
 
    public:
     Zero() {
@@ -26,33 +47,170 @@ class Zero {
     Zero(const long long strength) {
         search_driver.set_time_limit(strength);
     }
+    // a running ponder holds this engine's address, so the engine can't move
+    Zero(Zero&&) = delete;
+    ~Zero() {
+        stop_pondering();
+    }
 
     // SETTERS
+    // every setter stops a ponder first, as the ponder's thread owns the search driver
     void set_time_limit(long long x) {
+        stop_pondering();
         search_driver.set_time_limit(x);
     }
 
     void set_rollout_limit(long long x) {
+        stop_pondering();
         search_driver.set_rollout_limit(x);
     }
 
     void set_readout(bool b) {
+        stop_pondering();
+        readout = b;
         search_driver.set_readout(b);
     }
 
     void set_debug(bool b) {
+        stop_pondering();
         search_driver.set_debug(b);
     }
 
+    void set_batch_playouts(bool b) {
+        stop_pondering();
+        search_driver.set_batch_playouts(b);
+    }
+
+    void set_use_solved_table(bool b) {
+        stop_pondering();
+        search_driver.set_use_solved_table(b);
+    }
+
+    void set_use_threat_search(bool b) {
+        stop_pondering();
+        search_driver.set_use_threat_search(b);
+    }
+
+    void set_threat_playouts(bool b) {
+        stop_pondering();
+        search_driver.set_threat_playouts(b);
+    }
+
+    void set_heavy_playouts(bool b) {
+        stop_pondering();
+        search_driver.set_heavy_playouts(b);
+    }
+
+    void set_graph_search(bool b) {
+        stop_pondering();
+        search_driver.set_graph_search(b);
+    }
+
+    void set_compact_tree(bool b) {
+        stop_pondering();
+        search_driver.set_compact_tree(b);
+    }
+
+    void set_rave(bool b) {
+        stop_pondering();
+        search_driver.set_rave(b);
+    }
+
+    void set_rave_equivalence(double k) {
+        stop_pondering();
+        search_driver.set_rave_equivalence(k);
+    }
+
+    void set_progressive_bias(double weight) {
+        stop_pondering();
+        search_driver.set_progressive_bias(weight);
+    }
+
+    void set_progressive_widening(bool b) {
+        stop_pondering();
+        search_driver.set_progressive_widening(b);
+    }
+
+    void set_widening_exponent(double x) {
+        stop_pondering();
+        search_driver.set_widening_exponent(x);
+    }
+
+    void set_heuristic_scale(double x) {
+        stop_pondering();
+        search_driver.set_heuristic_scale(x);
+    }
+
+    void set_playout_cutoff(int plies) {
+        stop_pondering();
+        search_driver.set_playout_cutoff(plies);
+    }
+
+    void set_implicit_minimax(double weight) {
+        stop_pondering();
+        search_driver.set_implicit_minimax(weight);
+    }
+
+    void set_node_budget(size_t n) {
+        stop_pondering();
+        search_driver.set_node_budget(n);
+    }
+
+    void set_recycle_nodes(bool b) {
+        stop_pondering();
+        search_driver.set_recycle_nodes(b);
+    }
+
+    void set_time_management(bool b) {
+        stop_pondering();
+        search_driver.set_time_management(b);
+    }
+
+    void set_reuse_tree(bool b) {
+        stop_pondering();
+        search_driver.set_reuse_tree(b);
+    }
+
+    // pondering keeps the tree between moves, which it needs to hand its work on
+    void set_pondering(bool b) {
+        stop_pondering();
+        pondering = b;
+        if (b) {
+            search_driver.set_reuse_tree(true);
+            if (!search_driver.get_node_budget()) {
+                search_driver.set_node_budget(MCTS<State>::nodes_in_memory(PONDER_MEMORY));
+                search_driver.set_recycle_nodes(true);
+            }
+        }
+    }
+
+    void set_proof_search(bool b) {
+        stop_pondering();
+        use_proof_search = b;
+    }
+
+    void set_proof_threshold(double x) {
+        stop_pondering();
+        proof_threshold = x;
+    }
+
+    void set_proof_node_budget(long long x) {
+        stop_pondering();
+        proof_node_budget = x;
+    }
+
     void set_node(State n) {
+        stop_pondering();
         node = n;
     }
 
     void use_time_limit(bool x) {
+        stop_pondering();
         search_driver.use_time_limit(x);
     }
 
     void use_rollout_limit(bool x) {
+        stop_pondering();
         search_driver.use_rollout_limit(x);
     }
 
@@ -73,11 +231,24 @@ class Zero {
         return node.evaluate();
     }
 
-    auto get_node_count() const {
+    // the getters that read the search driver stop a ponder first, as it owns the driver
+    auto get_node_count() {
+        stop_pondering();
         return search_driver.get_nodes();
     }
 
-    auto get_win_prediction() const -> double {
+    auto get_tree_size() -> size_t {
+        stop_pondering();
+        return search_driver.get_tree_size();
+    }
+
+    auto get_memory_usage() -> size_t {
+        stop_pondering();
+        return search_driver.get_memory_usage();
+    }
+
+    auto get_win_prediction() -> double {
+        stop_pondering();
         // multiplies by 10 to get a weighted win-per-node percentage
         return 10 * search_driver.get_most_recent_winrate();
     }
@@ -93,16 +264,55 @@ class Zero {
     }
 
     void engine_move() {
+        stop_pondering();
         search_driver.set_side(node.get_turn());
-        node = search_driver.find_best_next_board(node);
+        State next = search_driver.find_best_next_board(node);
+        if constexpr (HasHash<State>) {
+            // sampling can't tell a near-certain win from a certain one, and can favour a
+            // move that only usually wins, so a dominant winrate is worth trying to prove.
+            // the proof gets whatever time the search left of the move, and no more.
+            if (use_proof_search && search_driver.get_most_recent_winrate() >= proof_threshold) {
+                auto proof_start = std::chrono::steady_clock::now();
+                auto [result, move] = prover.prove(node, proof_node_budget, search_driver.get_move_deadline());
+                search_driver.charge_time(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - proof_start).count());
+                if (result == DFPN<State>::PROVEN) {
+                    next = node;
+                    next.play(move);
+                }
+                if (readout) {
+                    std::cout << "proof search: " << (result == DFPN<State>::PROVEN ? "proven win" : result == DFPN<State>::DISPROVEN ? "no forced win" : "unresolved")
+                              << " in " << prover.get_nodes() << " nodes\n";
+                }
+            }
+        }
+        node = next;
+        if (pondering && !node.is_game_over()) {
+            start_pondering();
+        }
+    }
+
+    // searches the position after our move, and so every reply, until stop_pondering()
+    void start_pondering() {
+        stop_pondering();
+        stop_ponder->store(false);
+        ponder_thread = std::thread([this, position = node]() {
+            search_driver.ponder(position, *stop_ponder);
+        });
+    }
+
+    void stop_pondering() {
+        if (ponder_thread.joinable()) {
+            stop_ponder->store(true);
+            ponder_thread.join();
+        }
     }
 
     auto rollout_vector(State node) {
-        std::vector<int> child_rollout_counts = search_driver.get_rollout_counts(node);
-        std::vector<int> out(7);
-        int idx = 0;
-        for (int move : node.legal_moves()) {
-            out[move] = child_rollout_counts[idx++];
+        stop_pondering();
+        search_driver.set_side(node.get_turn());
+        std::vector<int> out(State::NUM_ACTIONS);
+        for (auto [move, visits] : search_driver.get_rollout_counts(node)) {
+            out[move] = visits;
         }
         return out;
     }
@@ -15,17 +15,16 @@ namespace std {
 namespace bench {
 
 template <typename ST>
-auto get_benchmark_engine() {
-    auto out = Zero<ST>();
-    out.use_rollout_limit(true);
-    out.set_readout(false);
-    out.set_debug(false);
-    return out;
+void setup_benchmark_engine(Zero<ST>& engine) {
+    engine.use_rollout_limit(true);
+    engine.set_readout(false);
+    engine.set_debug(false);
 }
 
 template <typename ST>
 void benchmark(int rollouts, int iterations) {
-    auto engine = get_benchmark_engine<ST>();
+    auto engine = Zero<ST>();
+    setup_benchmark_engine(engine);
     engine.set_rollout_limit(rollouts);
 
     auto total_time = 0LL;
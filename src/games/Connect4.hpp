@@ -5,9 +5,15 @@
 #include <cassert>
 #include <iostream>
 #include <numeric>
+#include <string>
 #include <vector>
 
+#include "../utilities/MappedTable.hpp"
 #include "../utilities/rng.hpp"
+#include "../utilities/simd.hpp"
+#include "../utilities/symmetry.hpp"
+#include "../utilities/zobrist.hpp"
+#include "Connect4Solver.hpp"
 
 namespace Connect4 {
 using Bitrow = uint_fast8_t;
@@ -23,13 +29,47 @@ class State {
     static constexpr int BB_ALL = (1 << NUM_COLS) - 1;
     static constexpr auto MAX_GAME_LENGTH = NUM_ROWS * NUM_COLS;
     static constexpr auto NUM_ACTIONS = NUM_COLS;
+    // passing is never worse than moving in a Connect4 zugzwang, so null-move pruning is unsound here
+    static constexpr auto NULL_MOVE_PRUNING = false;
 
     static_assert(!(NUM_ROWS == 6 && NUM_COLS == 7) || BB_ALL == 0b1111111, "Invalid BB_ALL");
 
+    // column-major bitboards give every column NUM_ROWS + 1 bits, bottom cell first,
+    // with an always-empty sentinel bit on top so that shifts can't wrap between columns.
+    static constexpr auto COL_HEIGHT = NUM_ROWS + 1;
+    static constexpr auto FITS_IN_BITBOARD = COL_HEIGHT * NUM_COLS <= 64;
+    static constexpr auto BATCH_SIZE = simd::LANES;
+    // boards small enough to be solved outright into a table (see PERFECT PLAY)
+    static constexpr auto TABULATED = COL_HEIGHT * NUM_COLS <= 24;
+    // larger boards whose keys fit the solver's table can be solved by search instead
+    static constexpr auto SEARCH_SOLVABLE = !TABULATED && COL_HEIGHT * NUM_COLS <= 55;
+    // the board and its mirror image
+    static constexpr auto NUM_SYMMETRIES = 2;
+
+   private:
+    static constexpr auto make_bottom_mask() -> Bitboard {
+        Bitboard out = 0;
+        for (int col = 0; col < NUM_COLS && col * COL_HEIGHT < 64; col++) {
+            out |= 1ULL << (col * COL_HEIGHT);
+        }
+        return out;
+    }
+
+   public:
+    static constexpr Bitboard BOTTOM_MASK = make_bottom_mask();
+    static constexpr Bitboard BOARD_MASK = BOTTOM_MASK * ((1ULL << NUM_ROWS) - 1);
+    static constexpr Bitboard COLUMN_MASK = (1ULL << NUM_ROWS) - 1;
+
    private:
+    // one key per (side, row, col), then one for a pass
+    static constexpr auto ZOBRIST_KEYS = zobrist::make_keys<2 * NUM_ROWS * NUM_COLS + 1>(0xC4);
+    static constexpr auto PASS_KEY = ZOBRIST_KEYS[2 * NUM_ROWS * NUM_COLS];
+
     std::array<std::array<Bitrow, NUM_COLS>, 2> node = {0};
     // std::array<Move, MAX_GAME_LENGTH> move_stack = {0};
     int_fast8_t move_count;
+    // the zobrist hash of the position and of its mirror image, updated incrementally
+    std::array<uint64_t, NUM_SYMMETRIES> zobrist_hashes = {0};
 
    public:
     State() {
@@ -49,6 +89,22 @@ class State {
         return move_count & 1;
     }
 
+    auto hash() const -> uint64_t {
+        return zobrist_hashes[0];
+    }
+
+    auto symmetric_hash(int sym) const -> uint64_t {
+        return zobrist_hashes[sym];
+    }
+
+    static auto transform_move(Move col, int sym) -> Move {
+        return sym ? NUM_COLS - 1 - col : col;
+    }
+
+    static auto inverse_symmetry(int sym) -> int {
+        return sym;
+    }
+
     // SETTERS
     void set_move_count(int n) {
         move_count = n;
@@ -101,39 +157,212 @@ class State {
         return moves;
     }
 
-    void random_play() {
-        // the union of the top rows
-        int bb = node[0][0] | node[1][0];
-        int num_moves = NUM_COLS - __builtin_popcount(bb);
-
-        // the chosen move
-        assert(num_moves != 0);
-        int choice = rng::random_int(num_moves);
-
+    auto nth_legal_move(size_t n) const -> Move {
         // this line creates an inverted occupancy for
         // the top row (0b0011000 -> 0b1100111)
-        bb = ~bb & BB_ALL;
+        int bb = ~(node[0][0] | node[1][0]) & BB_ALL;
 
         // the loop runs until
         // we hit the chosen move
-        while (choice) {
+        while (n) {
             // clear the least significant bit set
             bb &= bb - 1;
-            --choice;
+            --n;
+        }
+        assert(bb);
+        return __builtin_ctz(bb);
+    }
+
+    void random_play() {
+        int num_moves = num_legal_moves();
+
+        // the chosen move
+        assert(num_moves != 0);
+        play(nth_legal_move(rng::random_int(num_moves)));
+    }
+
+    // PLAYOUTS
+    auto rollout_to_end() const -> int
+        requires FITS_IN_BITBOARD
+    {
+        // plays random moves until the game ends, entirely on two local bitboards.
+        // only the side that just moved is checked for a win after each move.
+        std::array<Bitboard, 2> pos = {column_bitboard(0), column_bitboard(1)};
+        Bitboard mask = pos[0] | pos[1];
+        int side = move_count & 1;
+
+        // the game may already have been won by the last move
+        if (has_four(pos[side ^ 1])) {
+            return side ? 1 : -1;
+        }
+
+        for (int ply = move_count; ply < MAX_GAME_LENGTH; ply++) {
+            // the lowest empty cell of every column that isn't full
+            Bitboard moves = (mask + BOTTOM_MASK) & BOARD_MASK;
+            int choice = rng::fast_random_int(__builtin_popcountll(moves));
+            while (choice--) {
+                // clear the least significant bit set
+                moves &= moves - 1;
+            }
+            Bitboard cell = moves & -moves;
+            pos[side] |= cell;
+            mask |= cell;
+            if (has_four(pos[side])) {
+                return side ? -1 : 1;
+            }
+            side ^= 1;
+        }
+        return 0;
+    }
+
+    auto heavy_rollout_to_end() const -> int
+        requires FITS_IN_BITBOARD
+    {
+        // rollout_to_end(), but a side with a winning cell takes it, and a side facing one
+        // blocks it. the cells come from winning_cells(), so a move never needs checking
+        // for a win: a random one can't complete four unless it was a winning cell.
+        std::array<Bitboard, 2> pos = {column_bitboard(0), column_bitboard(1)};
+        Bitboard mask = pos[0] | pos[1];
+        int side = move_count & 1;
+
+        // the game may already have been won by the last move
+        if (has_four(pos[side ^ 1])) {
+            return side ? 1 : -1;
         }
 
-        if (!bb) {
-            std::cout << "you fucked up: " << std::endl;
-            auto original_bb = node[0][0] | node[1][0];
-            std::cout << "node: " << original_bb << std::endl;
-            std::cout << "num_moves: " << NUM_COLS - __builtin_popcount(original_bb) << std::endl;
+        for (int ply = move_count; ply < MAX_GAME_LENGTH; ply++) {
+            Bitboard moves = (mask + BOTTOM_MASK) & BOARD_MASK;
+            if (winning_cells(pos[side], mask) & moves) {
+                return side ? -1 : 1;
+            }
+            Bitboard blocks = winning_cells(pos[side ^ 1], mask) & moves;
+            if (blocks) {
+                moves = blocks;
+            }
+            int choice = rng::fast_random_int(__builtin_popcountll(moves));
+            while (choice--) {
+                // clear the least significant bit set
+                moves &= moves - 1;
+            }
+            Bitboard cell = moves & -moves;
+            pos[side] |= cell;
+            mask |= cell;
+            side ^= 1;
+        }
+        return 0;
+    }
+
+    auto rollout_batch() const -> std::array<int, BATCH_SIZE>
+        requires FITS_IN_BITBOARD
+    {
+        // plays BATCH_SIZE independent random playouts from this position in lock-step,
+        // one game per vector lane. every lane moves on every step, so the side to move
+        // is shared, and lanes that have finished are masked out until all are done.
+        using simd::u64xN;
+        std::array<int, BATCH_SIZE> out = {0};
+        int side = move_count & 1;
+        std::array<Bitboard, 2> start = {column_bitboard(0), column_bitboard(1)};
+
+        // the game may already have been won by the last move
+        if (has_four(start[side ^ 1])) {
+            out.fill(side ? 1 : -1);
+            return out;
         }
-        auto move = __builtin_ctz(bb);
 
-        play(move);
+        u64xN zero = {0};
+        std::array<u64xN, 2> pos = {zero + start[0], zero + start[1]};
+        u64xN mask = pos[0] | pos[1];
+        u64xN live = ~zero;
+        u64xN winners = zero;
+        for (int ply = move_count; ply < MAX_GAME_LENGTH && simd::any(live); ply++) {
+            // the lowest empty cell of every column that isn't full
+            u64xN moves = (mask + BOTTOM_MASK) & BOARD_MASK;
+
+            // pick a random column in every lane, re-rolling the lanes that hit a full one.
+            // this is uniform over the legal moves, without needing a per-lane bitscan.
+            u64xN cell = zero;
+            u64xN pending = live;
+            while (simd::any(pending)) {
+                u64xN shifts;
+                simd::random_int(NUM_COLS, shifts);
+                u64xN pick = moves & ((zero + COLUMN_MASK) << (shifts * COL_HEIGHT));
+                cell |= pick & pending;
+                u64xN picked;
+                simd::to_mask(pick, picked);
+                pending &= ~picked;
+            }
+
+            pos[side] |= cell;
+            mask |= cell;
+            u64xN won;
+            has_four_lanes(pos[side], won);
+            won &= live;
+            winners |= won & (side ? ~0ULL : 1ULL);
+            live &= ~won;
+            side ^= 1;
+        }
+
+        for (int i = 0; i < BATCH_SIZE; i++) {
+            out[i] = (int64_t)winners[i];
+        }
+        return out;
     }
 
     // DATA VIEWS
+    auto column_bitboard(int side) const -> Bitboard
+        requires FITS_IN_BITBOARD
+    {
+        // converts one side's rows (top row first) into a column-major bitboard
+        Bitboard out = 0;
+        for (int row = 0; row < NUM_ROWS; row++) {
+            int bits = node[side][row];
+            while (bits) {
+                int col = __builtin_ctz(bits);
+                out |= 1ULL << (col * COL_HEIGHT + (NUM_ROWS - 1 - row));
+                bits &= bits - 1;
+            }
+        }
+        return out;
+    }
+
+    static auto has_four(Bitboard bb) -> bool {
+        // vertical, both diagonals, and horizontal, in that order
+        for (int shift : {1, COL_HEIGHT - 1, COL_HEIGHT + 1, COL_HEIGHT}) {
+            Bitboard pairs = bb & (bb >> shift);
+            if (pairs & (pairs >> (2 * shift))) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the empty cells that would complete a line of four for the owner of position,
+    // as the solver's compute_winning_position()
+    static auto winning_cells(Bitboard position, Bitboard mask) -> Bitboard {
+        // vertical
+        Bitboard r = (position << 1) & (position << 2) & (position << 3);
+        // horizontal, then the two diagonals
+        for (int shift : {COL_HEIGHT, COL_HEIGHT - 1, COL_HEIGHT + 1}) {
+            Bitboard p = (position << shift) & (position << 2 * shift);
+            r |= p & (position << 3 * shift);
+            r |= p & (position >> shift);
+            p = (position >> shift) & (position >> 2 * shift);
+            r |= p & (position << shift);
+            r |= p & (position >> 3 * shift);
+        }
+        return r & (BOARD_MASK ^ mask);
+    }
+
+    static void has_four_lanes(const simd::u64xN& bb, simd::u64xN& out) {
+        // has_four(), setting an all-ones mask in every lane that has four in a row
+        simd::u64xN found = {0};
+        for (int shift : {1, COL_HEIGHT - 1, COL_HEIGHT + 1, COL_HEIGHT}) {
+            simd::u64xN pairs = bb & (bb >> shift);
+            found |= pairs & (pairs >> (2 * shift));
+        }
+        simd::to_mask(found, out);
+    }
+
     auto union_bitboard(int r) const -> Bitrow {
         // this function provides an occupancy number for a given row r, counting
         // downward, indexed from 0
@@ -179,10 +408,12 @@ class State {
 
     void pass_turn() {
         move_count++;
+        toggle_pass();
     }
 
     void unpass_turn() {
         move_count--;
+        toggle_pass();
     }
 
     void reset() {
@@ -190,6 +421,7 @@ class State {
         std::fill(node[1].begin(), node[1].end(), 0);
         // std::fill(move_stack.begin(), move_stack.end(), 0);
         move_count = 0;
+        zobrist_hashes.fill(0);
     }
 
     void play(int col) {
@@ -204,6 +436,7 @@ class State {
         // assert that row - 1 is in bounds
         assert(row - 1 >= 0 && row - 1 < NUM_ROWS);
         node[move_count & 1][row - 1] ^= (1 << col);
+        toggle_hashes(move_count & 1, row - 1, col);
         // store the made move in the stack
         // move_stack[move_count++] = col;
         move_count++;
@@ -234,8 +467,25 @@ class State {
         }
         // a bit is removed by XOR
         node[move_count & 1][row] ^= (1 << col);
+        toggle_hashes(move_count & 1, row, col);
+    }
+
+   private:
+    static auto zobrist_key(int side, int row, int col) -> uint64_t {
+        return ZOBRIST_KEYS[(side * NUM_ROWS + row) * NUM_COLS + col];
     }
 
+    void toggle_hashes(int side, int row, int col) {
+        zobrist_hashes[0] ^= zobrist_key(side, row, col);
+        zobrist_hashes[1] ^= zobrist_key(side, row, NUM_COLS - 1 - col);
+    }
+
+    void toggle_pass() {
+        zobrist_hashes[0] ^= PASS_KEY;
+        zobrist_hashes[1] ^= PASS_KEY;
+    }
+
+   public:
     // EVALUATION
    private:
     auto horizontal_term() const -> int {
@@ -317,6 +567,108 @@ class State {
         return val;  // use some sort of central weighting approach
     }
 
+    // central columns take part in more lines, so they are searched first.
+    // on the standard board this is the same ranking as weights.
+    auto static_move_score(Move col) const -> int {
+        return std::min<int>(col, NUM_COLS - 1 - col);
+    }
+
+    // PERFECT PLAY
+    // small boards are solved once into a table indexed by a perfect hash of the position:
+    // column c contributes (1 << height) | (X's stones, bottom first) at bit c * COL_HEIGHT.
+    // the table is written to disk on first use and memory-mapped on every run after that.
+    auto table_index() const -> size_t
+        requires TABULATED
+    {
+        size_t idx = 0;
+        for (int col = 0; col < NUM_COLS; col++) {
+            size_t column = 1;
+            for (int row = NUM_ROWS - 1; row >= 0 && pos_filled(row, col); row--) {
+                column = (column << 1) | player_at(row, col);
+            }
+            idx |= column << (col * COL_HEIGHT);
+        }
+        return idx;
+    }
+
+    auto solved_value() const -> int
+        requires TABULATED
+    {
+        return ((solved_table()[table_index()] >> 4) & 0b11) - 1;
+    }
+
+    auto solved_move() const -> Move
+        requires TABULATED
+    {
+        return solved_table()[table_index()] & 0b1111;
+    }
+
+    // larger boards are solved by search (see Connect4Solver.hpp). this takes seconds in
+    // the middlegame but far longer near the start, so the solver's table is kept between calls.
+    auto solve() const -> std::pair<int, Move>
+        requires SEARCH_SOLVABLE
+    {
+        auto [score, col] = solver().best_move(solver_position(), true);
+        // a positive score is a win for the side to move
+        int value = (score > 0) - (score < 0);
+        return {value * get_turn(), static_cast<Move>(col)};
+    }
+
+    auto solver_position() const -> typename Solver<NUM_ROWS, NUM_COLS>::Position
+        requires SEARCH_SOLVABLE
+    {
+        Bitboard current = column_bitboard(move_count & 1);
+        return {current, current | column_bitboard((move_count & 1) ^ 1), move_count};
+    }
+
+    static auto solver() -> Solver<NUM_ROWS, NUM_COLS>&
+        requires SEARCH_SOLVABLE
+    {
+        static auto instance = Solver<NUM_ROWS, NUM_COLS>();
+        return instance;
+    }
+
+   private:
+    // table entries are packed as SOLVED_FLAG | (value + 1) << 4 | move
+    static constexpr uint8_t SOLVED_FLAG = 0b10000000;
+
+    static auto solved_table() -> const MappedTable&
+        requires TABULATED
+    {
+        static const auto table = MappedTable(
+            "connect4_" + std::to_string(NUM_ROWS) + "x" + std::to_string(NUM_COLS) + ".solved",
+            size_t(1) << (COL_HEIGHT * NUM_COLS),
+            [](uint8_t* entries) { State().solve_into(entries); });
+        return table;
+    }
+
+    auto solve_into(uint8_t* entries) -> int {
+        // memoised negamax over every reachable position, returning the value as evaluate() does
+        auto idx = table_index();
+        if (entries[idx] & SOLVED_FLAG) {
+            return ((entries[idx] >> 4) & 0b11) - 1;
+        }
+        int value = evaluate();
+        Move best_move = 0;
+        if (!value && !is_full()) {
+            int sign = get_turn();
+            int best = -2;
+            for (auto move : legal_moves()) {
+                play(move);
+                int score = sign * solve_into(entries);
+                unplay(move);
+                if (score > best) {
+                    best = score;
+                    best_move = move;
+                }
+            }
+            value = sign * best;
+        }
+        entries[idx] = SOLVED_FLAG | (value + 1) << 4 | best_move;
+        return value;
+    }
+
+   public:
     // DATA GENERATION
     auto game_running() const -> bool {
         // the game is over if the board is filled up or someone has 4-in-a-row
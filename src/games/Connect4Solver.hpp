@@ -0,0 +1,332 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace Connect4 {
+
+// a strong solver for boards too large to tabulate, after Pascal Pons' design.
+// positions are column-major bitboards (NUM_ROWS + 1 bits per column, bottom first),
+// held from the point of view of the side to move. scores count how early the game is
+// won: a win with your last stone scores 1, a win with your first stone (W*H+1)/2 - 3,
+// and losses are the negation. the search is alpha-beta over non-losing moves only, with
+// threat-ordered moves and a table of upper bounds, run as a sequence of null-window
+// searches that binary-search the score.
+template <int NUM_ROWS, int NUM_COLS>
+class Solver {
+   public:
+    using Bitboard = uint64_t;
+    static constexpr auto COL_HEIGHT = NUM_ROWS + 1;
+    static constexpr auto NUM_CELLS = NUM_ROWS * NUM_COLS;
+    static constexpr auto MIN_SCORE = -NUM_CELLS / 2 + 3;
+    static constexpr auto MAX_SCORE = (NUM_CELLS + 1) / 2 - 3;
+    // 2^23 entries: the low bits of a key index the table and the high bits are stored,
+    // so keys of up to TT_BITS + 32 bits are stored exactly, with no false hits
+    static constexpr auto TT_BITS = 23;
+
+    static_assert(COL_HEIGHT * NUM_COLS <= TT_BITS + 32, "Board too large for the solver's keys");
+
+   private:
+    static constexpr auto make_bottom_mask() -> Bitboard {
+        Bitboard out = 0;
+        for (int col = 0; col < NUM_COLS; col++) {
+            out |= 1ULL << (col * COL_HEIGHT);
+        }
+        return out;
+    }
+    static constexpr Bitboard BOTTOM_MASK = make_bottom_mask();
+    static constexpr Bitboard BOARD_MASK = BOTTOM_MASK * ((1ULL << NUM_ROWS) - 1);
+
+    static constexpr auto bottom_mask_col(int col) -> Bitboard {
+        return 1ULL << (col * COL_HEIGHT);
+    }
+
+    static constexpr auto top_mask_col(int col) -> Bitboard {
+        return 1ULL << (NUM_ROWS - 1 + col * COL_HEIGHT);
+    }
+
+    static constexpr auto column_mask(int col) -> Bitboard {
+        return ((1ULL << NUM_ROWS) - 1) << (col * COL_HEIGHT);
+    }
+
+    // columns from the centre outwards, as central columns take part in more lines
+    static constexpr auto make_column_order() -> std::array<int, NUM_COLS> {
+        std::array<int, NUM_COLS> order = {};
+        for (int i = 0; i < NUM_COLS; i++) {
+            order[i] = NUM_COLS / 2 + (1 - 2 * (i % 2)) * (i + 1) / 2;
+        }
+        return order;
+    }
+    static constexpr auto COLUMN_ORDER = make_column_order();
+
+   public:
+    struct Position {
+        // the stones of the side to move, and every stone
+        Bitboard current = 0;
+        Bitboard mask = 0;
+        int moves = 0;
+
+        auto can_play(int col) const -> bool {
+            return (mask & top_mask_col(col)) == 0;
+        }
+
+        void play(Bitboard move) {
+            current ^= mask;
+            mask |= move;
+            moves++;
+        }
+
+        void play_col(int col) {
+            play((mask + bottom_mask_col(col)) & column_mask(col));
+        }
+
+        auto possible() const -> Bitboard {
+            return (mask + BOTTOM_MASK) & BOARD_MASK;
+        }
+
+        auto winning_position() const -> Bitboard {
+            return compute_winning_position(current, mask);
+        }
+
+        auto opponent_winning_position() const -> Bitboard {
+            return compute_winning_position(current ^ mask, mask);
+        }
+
+        auto can_win_next() const -> bool {
+            return winning_position() & possible();
+        }
+
+        auto is_winning_move(int col) const -> bool {
+            return winning_position() & possible() & column_mask(col);
+        }
+
+        // the moves that don't hand the opponent an immediate win. if the opponent has
+        // two threats that we can't both block, there are none.
+        auto possible_non_losing_moves() const -> Bitboard {
+            Bitboard possible_mask = possible();
+            Bitboard opponent_win = opponent_winning_position();
+            Bitboard forced_moves = possible_mask & opponent_win;
+            if (forced_moves) {
+                if (forced_moves & (forced_moves - 1)) {
+                    return 0;
+                }
+                possible_mask = forced_moves;
+            }
+            // never play directly beneath an opponent's winning cell
+            return possible_mask & ~(opponent_win >> 1);
+        }
+
+        // the number of winning cells the side to move would have after this move
+        auto move_score(Bitboard move) const -> int {
+            return __builtin_popcountll(compute_winning_position(current | move, mask));
+        }
+
+        // current + mask is unique per position: each column becomes its height bit
+        // plus the side to move's stones below it
+        auto key() const -> Bitboard {
+            return current + mask;
+        }
+
+        // the key of the position reflected left-to-right, which has the same score
+        auto mirrored_key() const -> Bitboard {
+            constexpr Bitboard COL_BITS = (1ULL << COL_HEIGHT) - 1;
+            Bitboard k = key();
+            Bitboard out = 0;
+            for (int col = 0; col < NUM_COLS; col++) {
+                out |= ((k >> (col * COL_HEIGHT)) & COL_BITS) << ((NUM_COLS - 1 - col) * COL_HEIGHT);
+            }
+            return out;
+        }
+
+        // one of each mirror pair, so that both share a table entry
+        auto canonical_key() const -> Bitboard {
+            return std::min(key(), mirrored_key());
+        }
+
+        // the empty cells that would complete a line of four for the owner of position
+        static auto compute_winning_position(Bitboard position, Bitboard mask) -> Bitboard {
+            // vertical
+            Bitboard r = (position << 1) & (position << 2) & (position << 3);
+            // horizontal, then the two diagonals
+            r |= lines_through(position, COL_HEIGHT);
+            r |= lines_through(position, COL_HEIGHT - 1);
+            r |= lines_through(position, COL_HEIGHT + 1);
+            return r & (BOARD_MASK ^ mask);
+        }
+
+        // cells with three stones in a line along the given shift, either side of them
+        static auto lines_through(Bitboard position, int shift) -> Bitboard {
+            Bitboard r = 0;
+            Bitboard p = (position << shift) & (position << 2 * shift);
+            r |= p & (position << 3 * shift);
+            r |= p & (position >> shift);
+            p = (position >> shift) & (position >> 2 * shift);
+            r |= p & (position << shift);
+            r |= p & (position >> 3 * shift);
+            return r;
+        }
+    };
+
+   private:
+    // upper bounds on scores, stored as score - MIN_SCORE + 1 so that zero means empty
+    std::vector<uint32_t> tt_keys;
+    std::vector<uint8_t> tt_values;
+    static constexpr Bitboard TT_MASK = (1ULL << TT_BITS) - 1;
+    long long node_count = 0;
+
+    void tt_put(Bitboard key, uint8_t value) {
+        tt_keys[key & TT_MASK] = static_cast<uint32_t>(key >> TT_BITS);
+        tt_values[key & TT_MASK] = value;
+    }
+
+    auto tt_get(Bitboard key) const -> uint8_t {
+        return tt_keys[key & TT_MASK] == static_cast<uint32_t>(key >> TT_BITS) ? tt_values[key & TT_MASK] : 0;
+    }
+
+    // up to NUM_COLS moves, kept sorted by score with insertion sort.
+    // ties go to the move added first, so moves are added in reverse preference order.
+    class MoveSorter {
+        std::array<std::pair<Bitboard, int>, NUM_COLS> entries;
+        int size = 0;
+
+       public:
+        void add(Bitboard move, int score) {
+            int pos = size++;
+            for (; pos && entries[pos - 1].second > score; pos--) {
+                entries[pos] = entries[pos - 1];
+            }
+            entries[pos] = {move, score};
+        }
+
+        // the best remaining move, or zero when there are none
+        auto next() -> Bitboard {
+            return size ? entries[--size].first : 0;
+        }
+    };
+
+    // the score of a position where the side to move can't win immediately,
+    // if it lies within (a, b); otherwise a bound on the far side of the window.
+    auto negamax(const Position& p, int a, int b) -> int {
+        node_count++;
+        Bitboard next = p.possible_non_losing_moves();
+        if (next == 0) {
+            // every move lets the opponent win straight away
+            return -(NUM_CELLS - p.moves) / 2;
+        }
+        if (p.moves >= NUM_CELLS - 2) {
+            return 0;
+        }
+        // the opponent can't win on their next move, so we can't lose that quickly
+        int min = -(NUM_CELLS - 2 - p.moves) / 2;
+        if (a < min) {
+            a = min;
+            if (a >= b) {
+                return a;
+            }
+        }
+        // we can't win immediately either
+        int max = (NUM_CELLS - 1 - p.moves) / 2;
+        Bitboard key = p.canonical_key();
+        if (int val = tt_get(key)) {
+            max = val + MIN_SCORE - 1;
+        }
+        if (b > max) {
+            b = max;
+            if (a >= b) {
+                return b;
+            }
+        }
+
+        // moves that create the most threats first, then central ones
+        MoveSorter moves;
+        for (int i = NUM_COLS - 1; i >= 0; i--) {
+            if (Bitboard move = next & column_mask(COLUMN_ORDER[i])) {
+                moves.add(move, p.move_score(move));
+            }
+        }
+        while (Bitboard move = moves.next()) {
+            Position child = p;
+            child.play(move);
+            int score = -negamax(child, -b, -a);
+            if (score >= b) {
+                return score;
+            }
+            if (score > a) {
+                a = score;
+            }
+        }
+        tt_put(key, a - MIN_SCORE + 1);
+        return a;
+    }
+
+   public:
+    Solver() : tt_keys(1ULL << TT_BITS), tt_values(1ULL << TT_BITS) {}
+
+    auto get_nodes() const -> long long {
+        return node_count;
+    }
+
+    void clear() {
+        std::fill(tt_keys.begin(), tt_keys.end(), 0);
+        std::fill(tt_values.begin(), tt_values.end(), 0);
+    }
+
+    // the exact score of a position that is not over. a weak solve only finds its sign,
+    // returning -1, 0 or 1, which is far cheaper as there is no need to find the quickest win.
+    auto solve(const Position& p, bool weak = false) -> int {
+        if (p.can_win_next()) {
+            return weak ? 1 : (NUM_CELLS + 1 - p.moves) / 2;
+        }
+        int min = weak ? -1 : -(NUM_CELLS - p.moves) / 2;
+        int max = weak ? 1 : (NUM_CELLS + 1 - p.moves) / 2;
+        // null-window searches, each halving the range the score could be in.
+        // probing nearer zero first settles wins and losses more cheaply than exact scores.
+        while (min < max) {
+            int med = min + (max - min) / 2;
+            if (med <= 0 && min / 2 < med) {
+                med = min / 2;
+            } else if (med >= 0 && max / 2 > med) {
+                med = max / 2;
+            }
+            int r = negamax(p, med, med + 1);
+            if (r <= med) {
+                max = r;
+            } else {
+                min = r;
+            }
+        }
+        return min;
+    }
+
+    // the score of the best move and the column to play it in, the central one on ties.
+    // a weak search takes the first winning move it finds, rather than the quickest win.
+    auto best_move(const Position& p, bool weak = false) -> std::pair<int, int> {
+        int best_score = -NUM_CELLS;
+        int best_col = -1;
+        for (int col : COLUMN_ORDER) {
+            if (!p.can_play(col)) {
+                continue;
+            }
+            int score;
+            if (p.is_winning_move(col)) {
+                score = weak ? 1 : (NUM_CELLS + 1 - p.moves) / 2;
+            } else {
+                Position child = p;
+                child.play_col(col);
+                score = child.moves == NUM_CELLS ? 0 : -solve(child, weak);
+            }
+            if (score > best_score) {
+                best_score = score;
+                best_col = col;
+            }
+            if (weak && best_score == 1) {
+                break;
+            }
+        }
+        return {best_score, best_col};
+    }
+};
+
+}  // namespace Connect4
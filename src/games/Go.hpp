@@ -90,8 +90,10 @@ class State {
         movestack.pop_back();
     }
 
-    auto is_game_over() -> int {
-        return ((movestack.end() - 1) == (movestack.end() - 2) && movestack.back() == -1);
+    auto is_game_over() const -> bool {
+        // the game ends when both players pass in succession
+        auto len = movestack.size();
+        return len >= 2 && movestack[len - 1] == -1 && movestack[len - 2] == -1;
     }
 
     void show_result() {
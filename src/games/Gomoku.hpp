@@ -5,10 +5,13 @@
 #include <cassert>
 #include <iostream>
 #include <numeric>
+#include <optional>
 #include <vector>
 
 #include "../utilities/BitMatrix.hpp"
 #include "../utilities/rng.hpp"
+#include "../utilities/symmetry.hpp"
+#include "../utilities/zobrist.hpp"
 
 namespace Gomoku {
 
@@ -40,10 +43,28 @@ class State {
     static constexpr auto MAX_GAME_LENGTH = WIDTH * HEIGHT;
     static constexpr auto NUM_ACTIONS = WIDTH * HEIGHT;
     static constexpr std::array<char, 2> players = {'X', 'O'};
+    // selective search in Negamax. there is no heuristic to prune on, so no futility pruning.
+    static constexpr auto NULL_MOVE_PRUNING = true;
+    static constexpr auto LATE_MOVE_REDUCTIONS = true;
+    // the eight symmetries of a square board, or the four of a rectangular one
+    static constexpr auto NUM_SYMMETRIES = WIDTH == HEIGHT ? 8 : 4;
+    // how many of its own moves the threat-space search gives the attacker, and how many
+    // threats it may try, which bounds its cost when the board is full of them
+    static constexpr auto THREAT_SEARCH_DEPTH = 4;
+    static constexpr auto THREAT_SEARCH_NODES = 64;
+    // what heuristic_value() makes of a cell that completes a five, against one that makes a four
+    static constexpr auto FOUR_WEIGHT = 4;
 
    private:
+    // one key per (side, square), then one for a pass
+    static constexpr auto ZOBRIST_KEYS = zobrist::make_keys<2 * WIDTH * HEIGHT + 1>(0x5);
+    static constexpr auto PASS_KEY = ZOBRIST_KEYS[2 * WIDTH * HEIGHT];
+    static constexpr auto SYMMETRIC_CELLS = symmetry::make_cell_table<WIDTH, HEIGHT, NUM_SYMMETRIES>();
+
     std::array<BB, 2> node;
     int move_count;
+    // the zobrist hash of the position under each symmetry (the identity first), updated incrementally
+    std::array<uint64_t, NUM_SYMMETRIES> zobrist_hashes = {0};
     // std::array<Move, MAX_GAME_LENGTH> move_stack = {0};
 
    public:
@@ -63,6 +84,23 @@ class State {
         return move_count & 1;
     }
 
+    auto hash() const -> uint64_t {
+        return zobrist_hashes[0];
+    }
+
+    auto symmetric_hash(int sym) const -> uint64_t {
+        return zobrist_hashes[sym];
+    }
+
+    static auto transform_move(Move move, int sym) -> Move {
+        return SYMMETRIC_CELLS[sym][move];
+    }
+
+    static auto inverse_symmetry(int sym) -> int {
+        // a rectangle's symmetries are all their own inverses
+        return NUM_SYMMETRIES == 8 ? symmetry::inverse(sym) : sym;
+    }
+
     auto is_full() const -> bool {
         return move_count == MAX_GAME_LENGTH;
     }
@@ -72,6 +110,7 @@ class State {
         node[1].reset();
         // std::fill(move_stack.begin(), move_stack.end(), 0);
         move_count = 0;
+        zobrist_hashes.fill(0);
     }
 
     void show() const {
@@ -134,6 +173,12 @@ class State {
         return WIDTH * HEIGHT - (node[0] | node[1]).popcount();
     }
 
+    auto nth_legal_move(size_t n) const -> Move {
+        auto bb = node[0] | node[1];
+        bb.flip();
+        return bb.nth_bit(n);
+    }
+
     auto legal_moves() const -> std::vector<Move> {
         std::vector<Move> moves;
 
@@ -160,15 +205,18 @@ class State {
 
     void pass_turn() {
         move_count++;
+        toggle_pass();
     }
 
     void unpass_turn() {
         move_count--;
+        toggle_pass();
     }
 
     void play(int i) {
         // move_count acts to determine which colour is played
         node[move_count & 1].set_bit(i);
+        toggle_hashes(move_count & 1, i);
         // store the made move in the stack
         // move_stack[move_count] = i;
         move_count++;
@@ -186,8 +234,23 @@ class State {
         --move_count;
         // a bit is removed
         node[move_count & 1].clear_bit(i);
+        toggle_hashes(move_count & 1, i);
     }
 
+   private:
+    void toggle_hashes(int side, int i) {
+        for (int sym = 0; sym < NUM_SYMMETRIES; sym++) {
+            zobrist_hashes[sym] ^= ZOBRIST_KEYS[side * WIDTH * HEIGHT + SYMMETRIC_CELLS[sym][i]];
+        }
+    }
+
+    void toggle_pass() {
+        for (auto& h : zobrist_hashes) {
+            h ^= PASS_KEY;
+        }
+    }
+
+   public:
     auto is_game_over() const -> bool {
         return is_full() || evaluate();
     }
@@ -257,55 +320,373 @@ class State {
         return 0;
     }
 
-    auto nevaluate() const -> int {
-        auto eval = 0;
-        if (node[0].has_n_in_a_row(5)){
-            eval = 1;
-        } else if (node[1].has_n_in_a_row(5)) {
-            eval = -1;
-        }
-        return eval;
-    }
-
    public:
     auto evaluate() const -> int {
         if (!move_count)
             return 0;
 
-        auto out = 0;
-        int v, h, u, d;
-        v = vertical_term();
-        if (v) {
-            out = v;
-            goto ret;
+        int v = vertical_term();
+        if (v)
+            return v;
+        int h = horizontal_term();
+        if (h)
+            return h;
+        int u = diagup_term();
+        if (u)
+            return u;
+
+        return diagdown_term();
+    }
+
+    // PLAYOUTS
+    auto rollout_to_end() const -> int {
+        // the game may already have been won by the last move
+        int status = evaluate();
+        if (status) {
+            return status;
         }
-        h = horizontal_term();
-        if (h) {
-            out = h;
-            goto ret;
+
+        // plays random moves on local copies of the boards until the game ends.
+        // empty squares are kept in a flat array so a move is picked in O(1),
+        // and only lines through the stone just placed are checked for a win.
+        std::array<typename BB::bitvec, 2> bbs = {node[0].data, node[1].data};
+        std::array<Move, MAX_GAME_LENGTH> empties;
+        int num_empties = 0;
+        auto occupied = bbs[0] | bbs[1];
+        for (int i = 0; i < MAX_GAME_LENGTH; i++) {
+            if (!occupied[i]) {
+                empties[num_empties++] = i;
+            }
         }
-        u = diagup_term();
-        if (u) {
-            out = u;
-            goto ret;
+
+        int side = move_count & 1;
+        while (num_empties) {
+            int idx = rng::fast_random_int(num_empties);
+            int sq = empties[idx];
+            empties[idx] = empties[--num_empties];
+            bbs[side].set(sq);
+            if (five_through(bbs[side], sq)) {
+                return side ? -1 : 1;
+            }
+            side ^= 1;
         }
-        d = diagdown_term();
-        if (d) {
-            out = d;
-            goto ret;
+        return 0;
+    }
+
+    auto heavy_rollout_to_end() const -> int {
+        // the game may already have been won by the last move
+        int status = evaluate();
+        if (status) {
+            return status;
         }
 
-       ret:
-        out = 0;
+        // rollout_to_end(), but a side with a winning cell takes it, and a side facing one
+        // blocks it. each side's winning cells are kept on a bitboard: computed in full
+        // once, then only the lines through each new stone can add to its owner's, and
+        // a random move can never make five, as it would have been a winning cell.
+        std::array<typename BB::bitvec, 2> bbs = {node[0].data, node[1].data};
+        std::array<Move, MAX_GAME_LENGTH> empties;
+        std::array<Move, MAX_GAME_LENGTH> where;
+        int num_empties = 0;
+        auto empty = ~(bbs[0] | bbs[1]);
+        for (int i = 0; i < MAX_GAME_LENGTH; i++) {
+            if (empty[i]) {
+                where[i] = num_empties;
+                empties[num_empties++] = i;
+            }
+        }
+        std::array<typename BB::bitvec, 2> wins = {winning_cells(bbs[0], empty), winning_cells(bbs[1], empty)};
 
-        auto new_eval = nevaluate();
+        int side = move_count & 1;
+        while (num_empties) {
+            if (wins[side].any()) {
+                return side ? -1 : 1;
+            }
+            int idx = wins[side ^ 1].any() ? where[wins[side ^ 1]._Find_first()] : rng::fast_random_int(num_empties);
+            int sq = empties[idx];
+            empties[idx] = empties[--num_empties];
+            where[empties[idx]] = idx;
+            bbs[side].set(sq);
+            empty.reset(sq);
+            wins[0].reset(sq);
+            wins[1].reset(sq);
+            add_winning_cells_through(bbs[side], empty, sq, wins[side]);
+            side ^= 1;
+        }
+        return 0;
+    }
+
+   private:
+    // adds to out the empty cells that make five with own in a line through sq
+    static void add_winning_cells_through(const typename BB::bitvec& own, const typename BB::bitvec& empty, int sq, typename BB::bitvec& out) {
+        static constexpr std::array<std::array<int, 2>, 4> directions = {{{0, 1}, {1, 0}, {1, 1}, {1, -1}}};
+        int row = sq / WIDTH;
+        int col = sq % WIDTH;
+        for (auto [dr, dc] : directions) {
+            // the line of nine cells centred on sq: stones are 1, gaps 0, and the
+            // opponent's stones and the cells off the board are -1
+            std::array<int, 9> line;
+            int stones = 0;
+            for (int k = -4; k <= 4; k++) {
+                int r = row + k * dr, c = col + k * dc;
+                int cell = r * WIDTH + c;
+                bool on_board = r >= 0 && r < HEIGHT && c >= 0 && c < WIDTH;
+                line[k + 4] = !on_board ? -1 : own[cell] ? 1 : empty[cell] ? 0 : -1;
+                stones += line[k + 4] == 1;
+            }
+            // sq and three more, at the least, for a four with a gap
+            if (stones < 4) {
+                continue;
+            }
+            for (int start = 0; start < 5; start++) {
+                int count = 0, gap = -1;
+                for (int k = start; k < start + 5; k++) {
+                    count += line[k] == 1;
+                    gap = line[k] == 0 ? k : gap;
+                }
+                if (count == 4 && gap >= 0) {
+                    out.set((row + (gap - 4) * dr) * WIDTH + col + (gap - 4) * dc);
+                }
+            }
+        }
+    }
 
-        printf("new eval: %d\n", new_eval);
-        printf("old eval: %d\n", out);
+    static auto five_through(const typename BB::bitvec& bb, int sq) -> bool {
+        // counts the stones in a line through sq, in each of the four directions
+        static constexpr std::array<std::array<int, 2>, 4> directions = {{{0, 1}, {1, 0}, {1, 1}, {1, -1}}};
+        int row = sq / WIDTH;
+        int col = sq % WIDTH;
+        for (auto [dr, dc] : directions) {
+            int count = 1;
+            for (int r = row + dr, c = col + dc; r >= 0 && r < HEIGHT && c >= 0 && c < WIDTH && bb[r * WIDTH + c]; r += dr, c += dc) {
+                count++;
+            }
+            for (int r = row - dr, c = col - dc; r >= 0 && r < HEIGHT && c >= 0 && c < WIDTH && bb[r * WIDTH + c]; r -= dr, c -= dc) {
+                count++;
+            }
+            if (count >= 5) {
+                return true;
+            }
+        }
+        return false;
+    }
 
+   public:
+    // THREATS
+    // a threat-space search: the attacker only plays fours (which make a five-threat) and
+    // threes (which threaten an open four, .XXXX.), and the defender only the replies that
+    // could stop them. a four has one reply; a three is answered by any cell that removes
+    // every open four it threatens, or by a four of the defender's own. everything else
+    // loses to the open four, so a win found here is a real one, though not every win is found.
+
+    // a move that wins by force for the side to move, within depth of its own moves
+    auto threat_search(int depth = THREAT_SEARCH_DEPTH, int budget = THREAT_SEARCH_NODES) const -> std::optional<Move> {
+        int win_move = -1;
+        if (threat_win(node[move_count & 1].data, node[(move_count + 1) & 1].data, depth, budget, &win_move)) {
+            return static_cast<Move>(win_move);
+        }
+        return std::nullopt;
+    }
+
+    // if the opponent has a four or an open three on the board, the only moves that might
+    // not lose to it, else none. if we have a five to play, that comes first, so also none.
+    auto forced_replies() const -> std::vector<Move> {
+        const auto& own = node[move_count & 1].data;
+        const auto& opp = node[(move_count + 1) & 1].data;
+        auto empty = ~(own | opp);
+        std::vector<Move> out;
+        if (winning_cells(own, empty).any()) {
+            return out;
+        }
+        auto replies = winning_cells(opp, empty);
+        if (replies.none() && open_four_cells(opp, empty).any()) {
+            replies = three_defences(opp, own, empty);
+        }
+        for (auto i = replies._Find_first(); i < replies.size(); i = replies._Find_next(i)) {
+            out.push_back(i);
+        }
+        return out;
+    }
+
+   private:
+    using bitvec = typename BB::bitvec;
+    using Direction = typename BB::Direction;
+    static constexpr std::array<Direction, 4> DIRECTIONS = {BB::HORIZONTAL, BB::VERTICAL, BB::DIAGONAL_45, BB::DIAGONAL_135};
+
+    // bb shifted back 0..N-1 cells along dir, so that entry j has, at each anchor, the cell j along from it
+    template <int N>
+    static auto window(const bitvec& bb, Direction dir) -> std::array<bitvec, N> {
+        std::array<bitvec, N> out;
+        for (int j = 0; j < N; j++) {
+            out[j] = BB::shift_along(bb, dir, -j);
+        }
+        return out;
+    }
+
+    // the empty cells that would make five (or more) in a row for own
+    static auto winning_cells(const bitvec& own, const bitvec& empty) -> bitvec {
+        bitvec out;
+        for (auto dir : DIRECTIONS) {
+            auto stones = window<5>(own, dir);
+            auto gaps = window<5>(empty, dir);
+            // four stones and a gap in a line of five
+            for (int m = 0; m < 5; m++) {
+                bitvec anchors = gaps[m];
+                for (int j = 0; j < 5; j++) {
+                    if (j != m) {
+                        anchors &= stones[j];
+                    }
+                }
+                out |= BB::shift_along(anchors, dir, m);
+            }
+        }
+        return out;
+    }
+
+    // the empty cells that would make a four for own
+    static auto four_making_cells(const bitvec& own, const bitvec& empty) -> bitvec {
+        bitvec out;
+        for (auto dir : DIRECTIONS) {
+            auto stones = window<5>(own, dir);
+            auto gaps = window<5>(empty, dir);
+            // three stones and two gaps in a line of five
+            for (int m1 = 0; m1 < 5; m1++) {
+                for (int m2 = m1 + 1; m2 < 5; m2++) {
+                    bitvec anchors = gaps[m1] & gaps[m2];
+                    for (int j = 0; j < 5; j++) {
+                        if (j != m1 && j != m2) {
+                            anchors &= stones[j];
+                        }
+                    }
+                    out |= BB::shift_along(anchors, dir, m1) | BB::shift_along(anchors, dir, m2);
+                }
+            }
+        }
+        return out;
+    }
+
+    // the empty cells that would make an open four (.XXXX.) for own, if with_ends is false.
+    // with it, the two open ends of each such line as well: every cell that could stop them.
+    static auto open_four_cells(const bitvec& own, const bitvec& empty, bool with_ends = false) -> bitvec {
+        bitvec out;
+        for (auto dir : DIRECTIONS) {
+            auto stones = window<6>(own, dir);
+            auto gaps = window<6>(empty, dir);
+            for (int m = 1; m < 5; m++) {
+                bitvec anchors = gaps[0] & gaps[5] & gaps[m];
+                for (int j = 1; j < 5; j++) {
+                    if (j != m) {
+                        anchors &= stones[j];
+                    }
+                }
+                out |= BB::shift_along(anchors, dir, m);
+                if (with_ends) {
+                    out |= anchors | BB::shift_along(anchors, dir, 5);
+                }
+            }
+        }
+        return out;
+    }
+
+    // the empty cells that would make an open three for own, i.e. threaten an open four
+    static auto three_making_cells(const bitvec& own, const bitvec& empty) -> bitvec {
+        bitvec out;
+        for (auto dir : DIRECTIONS) {
+            auto stones = window<6>(own, dir);
+            auto gaps = window<6>(empty, dir);
+            // two stones and two gaps between open ends
+            for (int m1 = 1; m1 < 5; m1++) {
+                for (int m2 = m1 + 1; m2 < 5; m2++) {
+                    bitvec anchors = gaps[0] & gaps[5] & gaps[m1] & gaps[m2];
+                    for (int j = 1; j < 5; j++) {
+                        if (j != m1 && j != m2) {
+                            anchors &= stones[j];
+                        }
+                    }
+                    out |= BB::shift_along(anchors, dir, m1) | BB::shift_along(anchors, dir, m2);
+                }
+            }
+        }
         return out;
     }
 
+    // the defender's replies to the attacker's open three(s): every cell that leaves the
+    // attacker no open four to make, and every four of the defender's own
+    static auto three_defences(const bitvec& attacker, const bitvec& defender, const bitvec& empty) -> bitvec {
+        bitvec out = four_making_cells(defender, empty);
+        bitvec candidates = open_four_cells(attacker, empty, true);
+        for (auto i = candidates._Find_first(); i < candidates.size(); i = candidates._Find_next(i)) {
+            bitvec rest = empty;
+            rest.reset(i);
+            if (open_four_cells(attacker, rest).none()) {
+                out.set(i);
+            }
+        }
+        return out;
+    }
+
+    // whether the attacker, to move, wins by threats within depth moves, and the first move if so.
+    // once the budget of threats to try runs out, every line still open counts as refuted.
+    static auto threat_win(const bitvec& attacker, const bitvec& defender, int depth, int& budget, int* win_move) -> bool {
+        auto empty = ~(attacker | defender);
+        auto fives = winning_cells(attacker, empty);
+        if (fives.any()) {
+            if (win_move) {
+                *win_move = fives._Find_first();
+            }
+            return true;
+        }
+        if (depth == 0) {
+            return false;
+        }
+        // a five-threat from the defender has to be blocked, so that is the only move;
+        // otherwise fours go first, as they leave the defender only one reply
+        auto blocks = winning_cells(defender, empty);
+        if (blocks.count() > 1) {
+            return false;
+        }
+        auto fours = blocks.any() ? blocks : four_making_cells(attacker, empty);
+        auto threes = blocks.any() ? bitvec() : three_making_cells(attacker, empty) & ~fours;
+        for (const auto& moves : {fours, threes}) {
+            for (auto a = moves._Find_first(); a < moves.size(); a = moves._Find_next(a)) {
+                if (--budget < 0) {
+                    return false;
+                }
+                auto next = attacker;
+                next.set(a);
+                auto rest = empty;
+                rest.reset(a);
+                auto next_fives = winning_cells(next, rest);
+                bitvec replies;
+                if (next_fives.count() > 1) {
+                    // the defender has no five of their own, and can only block one of ours
+                    replies.reset();
+                } else if (next_fives.any()) {
+                    replies = next_fives;
+                } else if (open_four_cells(next, rest).any()) {
+                    replies = three_defences(next, defender, rest);
+                } else {
+                    // not a threat, so the defender is free to do anything
+                    continue;
+                }
+                bool refuted = false;
+                for (auto r = replies._Find_first(); r < replies.size() && !refuted; r = replies._Find_next(r)) {
+                    auto reply = defender;
+                    reply.set(r);
+                    refuted = !threat_win(next, reply, depth - 1, budget, nullptr);
+                }
+                if (!refuted) {
+                    if (win_move) {
+                        *win_move = a;
+                    }
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+   public:
     void show_result() {
         int r;
         r = evaluate();
@@ -346,8 +727,16 @@ class State {
         return pos;
     }
 
-    auto heuristic_value() const -> uint_fast8_t {
-        return 0;
+    // X's threats less O's: a cell that would complete a five is worth FOUR_WEIGHT, and one
+    // that would make a four is worth one
+    auto heuristic_value() const -> int {
+        const auto& x = node[0].data;
+        const auto& o = node[1].data;
+        auto empty = ~(x | o);
+        int val = 0;
+        val += FOUR_WEIGHT * (int)winning_cells(x, empty).count() + (int)four_making_cells(x, empty).count();
+        val -= FOUR_WEIGHT * (int)winning_cells(o, empty).count() + (int)four_making_cells(o, empty).count();
+        return val;
     }
 
     friend auto operator==(const State& a, const State& b) -> bool {
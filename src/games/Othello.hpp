@@ -8,6 +8,9 @@
 #include <string>
 #include <sstream>
 
+#include "../utilities/symmetry.hpp"
+#include "../utilities/zobrist.hpp"
+
 namespace Othello {
 
 template <typename T>
@@ -38,8 +41,16 @@ class State {
     static constexpr auto MAX_GAME_LENGTH = WIDTH * HEIGHT;
     static constexpr auto NUM_ACTIONS = WIDTH * HEIGHT;
     static constexpr std::array<char, 2> players = {'X', 'O'};
+    // the symmetries of the board that keep the starting position fixed
+    static constexpr auto NUM_SYMMETRIES = 4;
 
    private:
+    static constexpr std::array<int, NUM_SYMMETRIES> SYMMETRIES = {
+        symmetry::IDENTITY, symmetry::ROTATE_180, symmetry::TRANSPOSE, symmetry::ANTI_TRANSPOSE};
+    static constexpr auto SYMMETRIC_CELLS = symmetry::make_cell_table<WIDTH, HEIGHT, 8>();
+    // one key per (side, square)
+    static constexpr auto ZOBRIST_KEYS = zobrist::make_keys<2 * WIDTH * HEIGHT>(0x0E);
+
     std::array<unsigned long long, 2> node = {0};
     int move_count;
     // std::array<Move, MAX_GAME_LENGTH> move_stack = {0};
@@ -61,6 +72,30 @@ class State {
         return move_count & 1;
     }
 
+    auto hash() const -> uint64_t {
+        return symmetric_hash(0);
+    }
+
+    // stones flip too often for incremental hashes to pay, so these are computed on demand
+    auto symmetric_hash(int sym) const -> uint64_t {
+        uint64_t h = 0;
+        for (int side = 0; side < 2; side++) {
+            for (auto bb = node[side]; bb; bb &= bb - 1) {
+                h ^= ZOBRIST_KEYS[side * WIDTH * HEIGHT + SYMMETRIC_CELLS[SYMMETRIES[sym]][__builtin_ctzll(bb)]];
+            }
+        }
+        return h;
+    }
+
+    static auto transform_move(Move move, int sym) -> Move {
+        return SYMMETRIC_CELLS[SYMMETRIES[sym]][move];
+    }
+
+    static auto inverse_symmetry(int sym) -> int {
+        // each of these is its own inverse
+        return sym;
+    }
+
     auto is_full() const -> bool {
         return move_count == MAX_GAME_LENGTH;
     }
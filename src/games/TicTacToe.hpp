@@ -2,24 +2,120 @@
 
 #include <algorithm>
 #include <array>
+#include <cassert>
+#include <cstdint>
 #include <iostream>
 #include <numeric>
 #include <sstream>
 #include <vector>
 
 #include "../utilities/rng.hpp"
+#include "../utilities/symmetry.hpp"
+#include "../utilities/zobrist.hpp"
 
 namespace TicTacToe {
 
+// the eight lines on the board, as bitmasks
+constexpr std::array<uint_fast16_t, 8> LINES = {
+    0b111000000,
+    0b000111000,
+    0b000000111,
+    0b100100100,
+    0b010010010,
+    0b001001001,
+    0b100010001,
+    0b001010100};
+
+constexpr auto has_line(uint_fast16_t bb) -> bool {
+    for (auto line : LINES) {
+        if ((bb & line) == line) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// PERFECT PLAY
+// every position is solved at compile time into a table indexed by a perfect hash
+// of the board: the base-3 number with digit i = 0 (empty), 1 (X) or 2 (O) for square i.
+struct SolvedEntry {
+    // the winner under perfect play, as evaluate() would give it
+    int8_t value;
+    // a move that achieves it, NO_MOVE if the game is over, or UNSOLVED
+    int8_t move;
+};
+
+constexpr auto TABLE_SIZE = 19683;  // 3^9
+constexpr int8_t NO_MOVE = -1;
+constexpr int8_t UNSOLVED = -2;
+
+constexpr auto table_index(uint_fast16_t xs, uint_fast16_t os) -> int {
+    int idx = 0;
+    for (int i = 8; i >= 0; --i) {
+        idx = idx * 3 + ((xs >> i) & 1) + 2 * ((os >> i) & 1);
+    }
+    return idx;
+}
+
+constexpr auto solve(std::array<SolvedEntry, TABLE_SIZE>& table, uint_fast16_t xs, uint_fast16_t os, int turn_index) -> int {
+    auto& entry = table[table_index(xs, os)];
+    if (entry.move != UNSOLVED) {
+        return entry.value;
+    }
+    // the side that just moved may have won
+    if (has_line(turn_index ? xs : os)) {
+        entry = {static_cast<int8_t>(turn_index ? 1 : -1), NO_MOVE};
+        return entry.value;
+    }
+    uint_fast16_t empty = ~(xs | os) & 0b111111111;
+    if (!empty) {
+        entry = {0, NO_MOVE};
+        return 0;
+    }
+    // negamax over the children, keeping the first of the best moves
+    int sign = turn_index ? -1 : 1;
+    int best = -2;
+    int8_t best_move = NO_MOVE;
+    while (empty) {
+        int i = __builtin_ctz(empty);
+        empty &= empty - 1;  // clear the least significant bit set
+        int value = turn_index ? solve(table, xs, os | (1 << i), 0) : solve(table, xs | (1 << i), os, 1);
+        if (sign * value > best) {
+            best = sign * value;
+            best_move = i;
+        }
+    }
+    entry = {static_cast<int8_t>(sign * best), best_move};
+    return entry.value;
+}
+
+constexpr auto build_solved_table() -> std::array<SolvedEntry, TABLE_SIZE> {
+    std::array<SolvedEntry, TABLE_SIZE> table;
+    table.fill({0, UNSOLVED});
+    solve(table, 0, 0, 0);
+    return table;
+}
+
+inline constexpr auto SOLVED_TABLE = build_solved_table();
+
+static_assert(SOLVED_TABLE[0].value == 0, "TicTacToe is a draw with perfect play");
+
 class State {
    public:
     using Move = uint_fast8_t;
     using Bitboard = uint_fast16_t;
+    static constexpr auto NUM_SYMMETRIES = 8;
 
    private:
+    // one key per (side, square)
+    static constexpr auto ZOBRIST_KEYS = zobrist::make_keys<2 * 9>(0x777);
+    static constexpr auto SYMMETRIC_CELLS = symmetry::make_cell_table<3, 3, NUM_SYMMETRIES>();
+
     std::array<Bitboard, 2> node = {0};
     std::array<Move, 9> move_stack;
     int move_count = 0;
+    // the zobrist hash of the position under each symmetry (the identity first), updated incrementally
+    std::array<uint64_t, NUM_SYMMETRIES> zobrist_hashes = {0};
 
    public:
     static constexpr auto GAME_SOLVABLE = true;
@@ -45,6 +141,22 @@ class State {
         return node;
     }
 
+    auto hash() const -> uint64_t {
+        return zobrist_hashes[0];
+    }
+
+    auto symmetric_hash(int sym) const -> uint64_t {
+        return zobrist_hashes[sym];
+    }
+
+    static auto transform_move(Move move, int sym) -> Move {
+        return SYMMETRIC_CELLS[sym][move];
+    }
+
+    static auto inverse_symmetry(int sym) -> int {
+        return symmetry::inverse(sym);
+    }
+
     // PREDICATES
     auto is_full() const -> bool {
         return move_count == 9;
@@ -79,26 +191,22 @@ class State {
         return moves;
     }
 
-    void random_play() {
-        // the union of the top rows
-        Bitboard bb = node[0] | node[1];
-        int num_moves = 9 - __builtin_popcount(bb);
-
-        // the chosen move
-        int choice = rng::random_int(num_moves);
-
-        // this line creates an inverted occupancy for
-        // the top row (0b0011000 -> 0b1100111)
-        bb = ~bb & BB_ALL;
+    auto nth_legal_move(size_t n) const -> Move {
+        // this line creates an inverted occupancy
+        // for the board (0b000011000 -> 0b111100111)
+        Bitboard bb = ~(node[0] | node[1]) & BB_ALL;
 
         // the loop runs until
         // we hit the chosen move
-        while (choice--) {
+        while (n--) {
             // clear the least significant bit set
             bb &= bb - 1;
         }
+        return __builtin_ctz(bb);
+    }
 
-        play(__builtin_ctz(bb));
+    void random_play() {
+        play(nth_legal_move(rng::random_int(num_legal_moves())));
     }
 
     // DATA VIEWS
@@ -131,10 +239,13 @@ class State {
 
     void reset() {
         std::fill(node.begin(), node.end(), 0);
+        move_count = 0;
+        zobrist_hashes.fill(0);
     }
 
     void play(int i) {
         node[move_count & 1] |= (1 << i);
+        toggle_hashes(move_count & 1, i);
         move_stack[move_count] = i;
         ++move_count;
     }
@@ -146,42 +257,47 @@ class State {
     void unplay() {
         int i = move_stack[--move_count];
         node[move_count & 1] ^= (1 << i);
+        toggle_hashes(move_count & 1, i);
     }
 
     void unplay(int i) {
         --move_count;
         node[move_count & 1] ^= (1 << i);
+        toggle_hashes(move_count & 1, i);
+    }
+
+   private:
+    void toggle_hashes(int side, int i) {
+        for (int sym = 0; sym < NUM_SYMMETRIES; sym++) {
+            zobrist_hashes[sym] ^= ZOBRIST_KEYS[side * 9 + SYMMETRIC_CELLS[sym][i]];
+        }
     }
 
+   public:
     // EVALUATION
+    auto last_move_won() const -> bool {
+        // only the side that just moved can have completed a line
+        return has_line(node[(move_count + 1) & 1]);
+    }
+
     auto evaluate() const -> int {
-        // check first diagonal
-        if (probe_spot(0) && probe_spot(4) && probe_spot(8)) {
-            return -get_turn();
-        }
-        // check second diagonal
-        if (probe_spot(2) && probe_spot(4) && probe_spot(6)) {
-            return -get_turn();
-        }
-        // check rows
-        for (int i = 0; i < 3; i++) {
-            if (probe_spot(i * 3) && probe_spot(i * 3 + 1) && probe_spot(i * 3 + 2)) {
-                return -get_turn();
-            }
-        }
-        // check columns
-        for (int i = 0; i < 3; i++) {
-            if (probe_spot(i) && probe_spot(i + 3) && probe_spot(i + 6)) {
-                return -get_turn();
-            }
-        }
-        return 0;
+        return last_move_won() ? -get_turn() : 0;
     }
 
     auto heuristic_value() const -> int {
         return 0;
     }
 
+    auto solved_value() const -> int {
+        return SOLVED_TABLE[table_index(node[0], node[1])].value;
+    }
+
+    auto solved_move() const -> Move {
+        auto move = SOLVED_TABLE[table_index(node[0], node[1])].move;
+        assert(move >= 0);
+        return move;
+    }
+
     // I/O
     auto charat(int y, int x) const {
         if (pos_filled(x * 3 + y)) {
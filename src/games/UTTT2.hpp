@@ -9,6 +9,8 @@
 #include <vector>
 
 #include "../utilities/rng.hpp"
+#include "../utilities/symmetry.hpp"
+#include "../utilities/zobrist.hpp"
 
 #define popcnt __builtin_popcount
 
@@ -32,6 +34,19 @@ constexpr auto contains_mask(int bb) -> bool {
 }
 
 namespace UTTT {
+// where each of the 81 cells goes under each symmetry of the square, which
+// moves a cell's sub-game and its place within the sub-game in the same way
+constexpr auto make_symmetric_cells() -> std::array<std::array<int, 81>, 8> {
+    constexpr auto squares = symmetry::make_cell_table<3, 3, 8>();
+    std::array<std::array<int, 81>, 8> table = {};
+    for (int sym = 0; sym < 8; sym++) {
+        for (int n = 0; n < 81; n++) {
+            table[sym][n] = squares[sym][n / 9] * 9 + squares[sym][n % 9];
+        }
+    }
+    return table;
+}
+
 class Square3x3 {
    public:
     std::array<int16_t, 2> slots = {0};
@@ -77,9 +92,20 @@ class State {
     static constexpr auto NUM_ACTIONS = 81;
     static constexpr auto MAX_GAME_LENGTH = 81;
     using Move = int;
+    // selective search in Negamax. UTTT has no zugzwang worth the name, so passing is a fair test.
+    static constexpr auto NULL_MOVE_PRUNING = true;
+    static constexpr auto LATE_MOVE_REDUCTIONS = true;
+    static constexpr auto FUTILITY_MARGIN = 4;
+    // the symmetries of the square act on the meta-board and every sub-game together
+    static constexpr auto NUM_SYMMETRIES = 8;
 
    private:
     static constexpr auto NO_SQUARE = -1;
+    // one key per (side, cell), then one per forced square (NO_SQUARE first), then one for a pass
+    static constexpr auto ZOBRIST_KEYS = zobrist::make_keys<2 * 81 + 11>(0x81);
+    static constexpr auto PASS_KEY = ZOBRIST_KEYS[2 * 81 + 10];
+    static constexpr auto SYMMETRIC_SQUARES = symmetry::make_cell_table<3, 3, NUM_SYMMETRIES>();
+    static constexpr auto SYMMETRIC_CELLS = make_symmetric_cells();
 
     // the game has nine sub-games, each of which is a 3x3 grid
     std::array<Square3x3, 9> node;
@@ -89,19 +115,22 @@ class State {
     int move_count;
     // the square upon which the player to move must play
     int current_forced_square;
-    // the forcing square on the turn before this one
-    int last_forced_square;
+    // the forcing square before each move, so that unplay() can restore it.
+    // passes advance move_count too, so there is room for as many of them as moves.
+    std::array<int8_t, 2 * MAX_GAME_LENGTH> forced_square_history;
     // whether the last move requires a game-over check
-    bool change_flag = true;
+    mutable bool change_flag = true;
     // the last result of check_game_over()
-    bool last_gameover_val = false;
+    mutable bool last_gameover_val = false;
+    // the zobrist hash of the stones on the board under each symmetry (the identity first),
+    // updated incrementally
+    std::array<uint64_t, NUM_SYMMETRIES> zobrist_hashes = {0};
 
    public:
     State() {
         std::fill(node.begin(), node.end(), Square3x3());
         move_count = 0;
         current_forced_square = NO_SQUARE;
-        last_forced_square = NO_SQUARE;
     }
 
     // GETTERS
@@ -121,6 +150,24 @@ class State {
         return node;
     }
 
+    auto hash() const -> uint64_t {
+        return symmetric_hash(0);
+    }
+
+    auto symmetric_hash(int sym) const -> uint64_t {
+        // the forced square changes the legal moves, so it is part of the position
+        int forced = current_forced_square == NO_SQUARE ? NO_SQUARE : SYMMETRIC_SQUARES[sym][current_forced_square];
+        return zobrist_hashes[sym] ^ ZOBRIST_KEYS[2 * 81 + 1 + forced];
+    }
+
+    static auto transform_move(Move move, int sym) -> Move {
+        return SYMMETRIC_CELLS[sym][move];
+    }
+
+    static auto inverse_symmetry(int sym) -> int {
+        return symmetry::inverse(sym);
+    }
+
     template < int player >
     auto get_global_bitmask() const -> int {
         int binary_accumulator = 0;
@@ -149,17 +196,23 @@ class State {
     }
 
     auto check_game_over() const -> bool {
+        // the game is over when there are no live squares left to play in
+        bool all_dead = true;
         for (auto sq_idx = 0; sq_idx < 9; ++sq_idx) {
-            if (cached_is_dead(sq_idx)) {
-                return true;
+            if (!cached_is_dead(sq_idx)) {
+                all_dead = false;
+                break;
             }
         }
+        if (all_dead) {
+            return true;
+        }
 
         return contains_mask(get_global_bitmask<0>()) 
             || contains_mask(get_global_bitmask<1>());
     }
    public:
-    auto is_game_over() -> bool {
+    auto is_game_over() const -> bool {
         if (move_count == MAX_GAME_LENGTH) {
             return true;
         }
@@ -222,17 +275,14 @@ class State {
         return moves;
     }
 
-    void random_play() {
-        assert(num_legal_moves() > 0);
-        int choice = rng::random_int(num_legal_moves());
+    auto nth_legal_move(size_t n) const -> Move {
         if (current_forced_square == NO_SQUARE) {
             for (int sq_idx = 0; sq_idx < 9; ++sq_idx) {
                 if (!cached_is_dead(sq_idx)) {
                     int bb = ~union_bb(node[sq_idx]) & 0b111111111;
                     while (bb) {
-                        if (!choice--) {
-                            play(sq_idx * 9 + __builtin_ctz(bb));
-                            return;
+                        if (!n--) {
+                            return sq_idx * 9 + __builtin_ctz(bb);
                         }
                         bb &= bb - 1;  // clear the least significant bit set
                     }
@@ -241,13 +291,96 @@ class State {
         } else {
             int bb = ~union_bb(node[current_forced_square]) & 0b111111111;
             while (bb) {
-                if (!choice--) {
-                    play(current_forced_square * 9 + __builtin_ctz(bb));
-                    return;
+                if (!n--) {
+                    return current_forced_square * 9 + __builtin_ctz(bb);
                 }
                 bb &= bb - 1;  // clear the least significant bit set
             }
         }
+        assert(false);
+        return 0;
+    }
+
+    void random_play() {
+        assert(num_legal_moves() > 0);
+        play(nth_legal_move(rng::random_int(num_legal_moves())));
+    }
+
+    // PLAYOUTS
+    auto rollout_to_end() const -> int {
+        if (is_game_over()) {
+            return evaluate();
+        }
+
+        // plays random moves until the game ends, on local copies of the squares.
+        // won squares are tracked as 9-bit masks (bit n = square n), so only the
+        // square just played in and the mover's meta-board need checking.
+        std::array<std::array<int, 9>, 2> slots;
+        std::array<int, 2> won = {0, 0};
+        int dead = 0;
+        for (int sq_idx = 0; sq_idx < 9; ++sq_idx) {
+            slots[0][sq_idx] = node[sq_idx].slots[0];
+            slots[1][sq_idx] = node[sq_idx].slots[1];
+            won[0] |= node[sq_idx].is_won_by<0>() << sq_idx;
+            won[1] |= node[sq_idx].is_won_by<1>() << sq_idx;
+            dead |= node[sq_idx].is_dead() << sq_idx;
+        }
+
+        int side = move_count & 1;
+        int forced = current_forced_square;
+        while (true) {
+            int sq_idx = forced;
+            int bb;
+            int choice;
+            if (forced != NO_SQUARE) {
+                bb = ~(slots[0][forced] | slots[1][forced]) & 0b111111111;
+                choice = rng::fast_random_int(popcnt(bb));
+            } else {
+                // count the moves over all live squares, then walk to the chosen one
+                int count = 0;
+                for (int i = 0; i < 9; ++i) {
+                    if (!(dead & (1 << i))) {
+                        count += 9 - popcnt(slots[0][i] | slots[1][i]);
+                    }
+                }
+                if (!count) {
+                    break;
+                }
+                choice = rng::fast_random_int(count);
+                for (sq_idx = 0;; ++sq_idx) {
+                    if (dead & (1 << sq_idx)) {
+                        continue;
+                    }
+                    bb = ~(slots[0][sq_idx] | slots[1][sq_idx]) & 0b111111111;
+                    int n = popcnt(bb);
+                    if (choice < n) {
+                        break;
+                    }
+                    choice -= n;
+                }
+            }
+            while (choice--) {
+                bb &= bb - 1;  // clear the least significant bit set
+            }
+            int location_in_square = __builtin_ctz(bb);
+
+            slots[side][sq_idx] |= 1 << location_in_square;
+            if (contains_mask(slots[side][sq_idx])) {
+                won[side] |= 1 << sq_idx;
+                dead |= 1 << sq_idx;
+                if (contains_mask(won[side])) {
+                    return side ? -1 : 1;
+                }
+            } else if ((slots[0][sq_idx] | slots[1][sq_idx]) == 0b111111111) {
+                dead |= 1 << sq_idx;
+            }
+
+            forced = (dead & (1 << location_in_square)) ? NO_SQUARE : location_in_square;
+            side ^= 1;
+        }
+
+        int diff = popcnt(won[0]) - popcnt(won[1]);
+        return (diff > 0) - (diff < 0);
     }
 
     // DATA VIEWS
@@ -261,17 +394,26 @@ class State {
 
     void pass_turn() {
         move_count++;
+        for (auto& h : zobrist_hashes) {
+            h ^= PASS_KEY;
+        }
     }
 
     void unpass_turn() {
         move_count--;
+        for (auto& h : zobrist_hashes) {
+            h ^= PASS_KEY;
+        }
     }
 
     void reset() {
         std::fill(node.begin(), node.end(), Square3x3());
+        std::fill(square_ended_cache.begin(), square_ended_cache.end(), false);
         move_count = 0;
         current_forced_square = NO_SQUARE;
-        last_forced_square = NO_SQUARE;
+        change_flag = true;
+        last_gameover_val = false;
+        zobrist_hashes.fill(0);
     }
 
     void play(int n) {
@@ -280,8 +422,9 @@ class State {
         int location_in_square = n % 9;
         // add a bit to the square
         node[target_square].slots[move_count & 1] ^= 1 << location_in_square;
-        // as we are moving forward, the current forced square becomes the last forced square
-        last_forced_square = current_forced_square;
+        toggle_hashes(move_count & 1, n);
+        // remember the forced square so that it can be restored
+        forced_square_history[move_count] = current_forced_square;
         // set the new forced square
         if (cached_is_dead(location_in_square)) {
             // if the target is unplayable, the forced square is NO_SQUARE
@@ -304,16 +447,32 @@ class State {
         int location_in_square = n % 9;
         // remove a bit from the square
         node[target_square].slots[move_count & 1] ^= 1 << location_in_square;
-        // as we are moving backward, the last forced square becomes the current forced square
-        current_forced_square = last_forced_square;
-        // you'd think we now need to set LFS to something else, but we
-        // A. do not have access to that information
-        // B. do not ever need to access LFS again, as we never unplay more than one move at a time.
+        toggle_hashes(move_count & 1, n);
+        // the square was live before this move was played into it
+        square_ended_cache[target_square] = false;
+        // restore the forced square from before this move
+        current_forced_square = forced_square_history[move_count];
 
         last_gameover_val = false;
     }
 
+   private:
+    void toggle_hashes(int side, int n) {
+        for (int sym = 0; sym < NUM_SYMMETRIES; sym++) {
+            zobrist_hashes[sym] ^= ZOBRIST_KEYS[side * 81 + SYMMETRIC_CELLS[sym][n]];
+        }
+    }
+
+   public:
     // EVALUATION
+    auto last_move_won() const -> bool {
+        // only the side that just moved can have completed a line of squares
+        if (move_count & 1) {
+            return contains_mask(get_global_bitmask<0>());
+        }
+        return contains_mask(get_global_bitmask<1>());
+    }
+
     auto evaluate() const -> int {
         // construct two binary numbers that represent the meta-board in the same way that the squares individually operate
         int xs = get_global_bitmask<0>();
@@ -330,8 +489,18 @@ class State {
         return (diff > 0) - (diff < 0);
     }
 
-    auto heuristic_value() {
-        return 0;
+    // won sub-games, weighted by how many lines of the meta-board pass through them
+    auto heuristic_value() const -> int {
+        constexpr std::array<int, 9> SQUARE_WEIGHTS = {3, 2, 3, 2, 4, 2, 3, 2, 3};
+        int val = 0;
+        for (int i = 0; i < 9; i++) {
+            if (contains_mask(node[i].slots[0])) {
+                val += SQUARE_WEIGHTS[i];
+            } else if (contains_mask(node[i].slots[1])) {
+                val -= SQUARE_WEIGHTS[i];
+            }
+        }
+        return val;
     }
 
     // IO
@@ -397,7 +566,6 @@ class State {
 
         std::cout << sb.str();
         // std::cout << "\ncurrent forced board: " << current_forced_square << "\n";
-        // std::cout << "last forced board: " << last_forced_square << "\n";
         // std::cout << "eval: " << evaluate() << "\n";
         // std::cout << "num legal moves: " << num_legal_moves() << "\n";
     }
@@ -2,15 +2,13 @@
 #pragma GCC target("avx")
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
-#include <climits>
-#include <cmath>
 #include <cstdlib>
-#include <ctime>
 #include <iostream>
-#include <optional>
-#include <unordered_map>
+#include <string>
+#include <thread>
 #include <vector>
 
 // #include "Checkers.hpp"
@@ -21,103 +19,159 @@
 // #include "RawTree.hpp"
 #include "games/TicTacToe.hpp"
 #include "games/UTTT2.hpp"
+#include "GameState.hpp"
+#include "utilities/zobrist.hpp"
 
-template <class GameType>
+// a shared table of subtree sizes, keyed by position hash and depth.
+// entries are two relaxed atomics storing (key ^ count, count), so a torn
+// write from a racing thread fails the key check instead of giving a wrong count.
+class PerftTable {
+    static constexpr auto DEPTH_KEYS = zobrist::make_keys<64>(0xDE97);
+
+    struct Entry {
+        std::atomic<uint64_t> check;
+        std::atomic<uint64_t> count;
+    };
+    std::vector<Entry> entries;
+    uint64_t mask;
+
+   public:
+    PerftTable(size_t megabytes) {
+        // round down to a power of two so that indexing is a mask
+        size_t num_entries = 1;
+        while (num_entries * 2 * sizeof(Entry) <= megabytes * 1024 * 1024) {
+            num_entries *= 2;
+        }
+        entries = std::vector<Entry>(megabytes ? num_entries : 0);
+        mask = num_entries - 1;
+    }
+
+    auto probe(uint64_t hash, int depth, uint64_t& count) const -> bool {
+        if (entries.empty()) {
+            return false;
+        }
+        uint64_t key = hash ^ DEPTH_KEYS[depth];
+        const auto& entry = entries[key & mask];
+        count = entry.count.load(std::memory_order_relaxed);
+        return (entry.check.load(std::memory_order_relaxed) ^ count) == key;
+    }
+
+    void store(uint64_t hash, int depth, uint64_t count) {
+        if (entries.empty()) {
+            return;
+        }
+        uint64_t key = hash ^ DEPTH_KEYS[depth];
+        auto& entry = entries[key & mask];
+        entry.check.store(key ^ count, std::memory_order_relaxed);
+        entry.count.store(count, std::memory_order_relaxed);
+    }
+};
+
+template <GameState GameType>
 class Perft {
+    PerftTable& table;
+
    public:
-    GameType node;
-    int nodes = 0;
+    Perft(PerftTable& table) : table(table) {}
 
-    void perftx(int n) {
+    auto perftx(GameType& node, int n) -> uint64_t {
         if (n == 0) {
-            nodes++;
-        } else {
-            for (auto move : node.legal_moves()) {
-                node.play(move);
-                perftx(n - 1);
-                node.unplay();
+            return 1;
+        }
+        if constexpr (HasNumLegalMoves<GameType>) {
+            // bulk-count the leaves rather than visiting them
+            if (n == 1) {
+                return node.num_legal_moves();
+            }
+        }
+        if constexpr (HasHash<GameType>) {
+            uint64_t cached;
+            if (table.probe(node.hash(), n, cached)) {
+                return cached;
             }
         }
+        uint64_t nodes = 0;
+        for (auto move : node.legal_moves()) {
+            node.play(move);
+            nodes += perftx(node, n - 1);
+            node.unplay(move);
+        }
+        if constexpr (HasHash<GameType>) {
+            table.store(node.hash(), n, nodes);
+        }
+        return nodes;
     }
 
-    void perft(int n) {
-        nodes = 0;
-        perftx(n);
-        std::cout << nodes << "\n";
+    auto perft(const GameType& root, int n, int num_threads) -> uint64_t {
+        if (n <= 1) {
+            GameType node = root;
+            return perftx(node, n);
+        }
+        // the root moves are handed out to a pool of workers one at a time
+        auto moves = root.legal_moves();
+        std::atomic<size_t> next_move = 0;
+        std::atomic<uint64_t> nodes = 0;
+        auto worker = [&]() {
+            GameType node = root;
+            for (size_t i = next_move++; i < moves.size(); i = next_move++) {
+                node.play(moves[i]);
+                nodes += perftx(node, n - 1);
+                node.unplay(moves[i]);
+            }
+        };
+        std::vector<std::thread> pool;
+        for (int t = 0; t < num_threads; t++) {
+            pool.emplace_back(worker);
+        }
+        for (auto& thread : pool) {
+            thread.join();
+        }
+        return nodes;
     }
 };
 
-namespace Games {
-enum names : int {
-    Checkers = 1,
-    Connect4,
-    Connect4x4,
-    Go,
-    Gomoku,
-    RawTree,
-    TicTacToe,
-    UTTT
-};
+template <GameState GameType>
+void run_perft(int max_depth, int num_threads, size_t hash_mb) {
+    auto table = PerftTable(hash_mb);
+    auto engine = Perft<GameType>(table);
+    auto root = GameType();
+    for (int depth = 1; depth <= max_depth; depth++) {
+        auto start = std::chrono::steady_clock::now();
+        auto nodes = engine.perft(root, depth, num_threads);
+        auto time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+        printf("depth %2d: %14llu nodes in %8.1fms at %.0f NPS.\n",
+               depth,
+               (unsigned long long)nodes,
+               time / 1000.0,
+               nodes / (std::max(time, 1L) / 1e6));
+    }
 }
 
 int main(int argc, char const *argv[]) {
-    std::cout << "Perft movegen checker: would you like to check Checkers[1], Connect4[2], Connect4(4x4)[3], Go[4], Gomoku[5], RawTree[6], TicTacToe[7], or UTTT[8]?\n--> ";
-    int response;
-    std::cin >> response;
-
-    // Perft<Checkers::State> engine1;
-    Perft<Connect4::State<6, 7>> engine2;
-    Perft<Connect4x4::State> engine3;
-    // Perft<Go::State> engine4;
-    Perft<Gomoku::State<8, 8>> engine5;
-    // Perft<RawTree::State, RawTree::Move> engine6;
-    Perft<TicTacToe::State> engine7;
-    Perft<UTTT::State> engine8;
+    if (argc <= 2) {
+        std::cout << "Run with arg1: game [connect4, connect4x4, gomoku, tictactoe, uttt], arg2: depth, arg3: threads (default 1), arg4: hash MB (default 64, 0 disables).\n";
+        return 0;
+    }
 
-    switch (response) {
-        // case Games::Checkers:
-        //     for (int i = 0; i < 10; i++) {
-        //         engine1.perft(i);
-        //     }
-        //     break;
-        case Games::Connect4:
-            for (int i = 0; i < 10; i++) {
-                engine2.perft(i);
-            }
-            break;
-        case Games::Connect4x4:
-            for (int i = 0; i < 10; i++) {
-                engine3.perft(i);
-            }
-            break;
-        // case Games::Go:
-        //     for (int i = 0; i < 4; i++) {
-        //         engine4.perft(i);
-        //     }
-        //     break;
-        case Games::Gomoku:
-            for (int i = 0; i < 10; i++) {
-                engine5.perft(i);
-            }
-            break;
-        // case Games::RawTree:
-        //     for (int i = 0; i < 2; i++) {
-        //         engine6.perft(i);
-        //     }
-        //     break;
-        case Games::TicTacToe:
-            for (int i = 0; i < 9; i++) {
-                engine7.perft(i);
-            }
-            break;
-        case Games::UTTT:
-            for (int i = 0; i < 10; i++) {
-                engine8.perft(i);
-            }
-            break;
+    auto game = std::string(argv[1]);
+    auto depth = atoi(argv[2]);
+    auto threads = argc > 3 ? atoi(argv[3]) : 1;
+    auto hash_mb = argc > 4 ? atoi(argv[4]) : 64;
 
-        default:
-            break;
+    // Checkers, Go and RawTree don't compile at the moment.
+    if (game == "connect4") {
+        run_perft<Connect4::State<6, 7>>(depth, threads, hash_mb);
+    } else if (game == "connect4x4") {
+        run_perft<Connect4x4::State>(depth, threads, hash_mb);
+    } else if (game == "gomoku") {
+        run_perft<Gomoku::State<8, 8>>(depth, threads, hash_mb);
+    } else if (game == "tictactoe") {
+        run_perft<TicTacToe::State>(depth, threads, hash_mb);
+    } else if (game == "uttt") {
+        run_perft<UTTT::State>(depth, threads, hash_mb);
+    } else {
+        std::cout << "unknown game: " << game << "\n";
+        return 1;
     }
     return 0;
 }
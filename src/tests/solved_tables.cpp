@@ -0,0 +1,194 @@
+#include "../games/Connect4-4x4.hpp"
+#include "../games/Connect4.hpp"
+#include "../games/Gomoku.hpp"
+#include "../games/TicTacToe.hpp"
+#include "../MCSearch.hpp"
+#include "../NMSearch.hpp"
+#include "../PNSearch.hpp"
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+// checks the solved tables against a full alpha-beta solve, over random positions
+template <class State>
+auto test_solved_table(const char* name, int positions) -> int {
+    auto searcher = Negamax<State>();
+    int failures = 0;
+    for (int i = 0; i < positions; i++) {
+        State node;
+        int plies = rng::random_int(State::MAX_GAME_LENGTH);
+        for (int p = 0; p < plies && !node.is_game_over(); p++) {
+            node.random_play();
+        }
+        int expected = searcher.dnegamax(node, node.get_turn()) * node.get_turn();
+        if (node.solved_value() != expected) {
+            node.show();
+            std::cout << "table: " << node.solved_value() << " search: " << expected << "\n";
+            failures++;
+            continue;
+        }
+        if (node.is_game_over()) {
+            continue;
+        }
+        // the table's move must keep the position's value
+        auto move = node.solved_move();
+        node.play(move);
+        if (node.solved_value() != expected) {
+            std::cout << "table move " << (int)move << " does not preserve the value\n";
+            failures++;
+        }
+    }
+    std::cout << name << ": " << positions - failures << "/" << positions << " positions agree\n";
+    return failures;
+}
+
+// checks a search-based solver against a full alpha-beta solve, over random positions
+template <class State>
+auto test_exact_solver(const char* name, int positions, int min_plies) -> int {
+    auto searcher = Negamax<State>();
+    int failures = 0;
+    for (int i = 0; i < positions; i++) {
+        State node;
+        // the reference search is slow near the start, so skip the first few plies
+        int plies = min_plies + rng::random_int(State::MAX_GAME_LENGTH - min_plies);
+        for (int p = 0; p < plies && !node.is_game_over(); p++) {
+            node.random_play();
+        }
+        if (node.is_game_over()) {
+            continue;
+        }
+        int expected = searcher.dnegamax(node, node.get_turn()) * node.get_turn();
+        auto [value, move] = node.solve();
+        node.play(move);
+        // the solver's move must keep the position's value
+        int after = searcher.dnegamax(node, node.get_turn()) * node.get_turn();
+        if (value != expected || after != expected) {
+            std::cout << "solver: " << value << " search: " << expected << " after solver move: " << after << "\n";
+            failures++;
+        }
+    }
+    std::cout << name << ": " << positions - failures << "/" << positions << " positions agree\n";
+    return failures;
+}
+
+// checks df-pn's proofs and disproofs of a win for the side to move against a full alpha-beta solve
+template <class State>
+auto test_proof_search(const char* name, int positions, int min_plies) -> int {
+    auto searcher = Negamax<State>();
+    auto prover = DFPN<State>();
+    int failures = 0;
+    for (int i = 0; i < positions; i++) {
+        State node;
+        int plies = min_plies + rng::random_int(State::MAX_GAME_LENGTH - min_plies);
+        for (int p = 0; p < plies && !node.is_game_over(); p++) {
+            node.random_play();
+        }
+        if (node.is_game_over()) {
+            continue;
+        }
+        bool won = searcher.dnegamax(node, node.get_turn()) == 1;
+        auto [result, move] = prover.prove(node, 1LL << 40);
+        bool ok = result == (won ? DFPN<State>::PROVEN : DFPN<State>::DISPROVEN);
+        if (ok && won) {
+            // the proof's move must keep the win
+            node.play(move);
+            ok = searcher.dnegamax(node, node.get_turn()) == -1;
+        }
+        if (!ok) {
+            std::cout << "df-pn: " << result << " search: " << won << "\n";
+            failures++;
+        }
+    }
+    std::cout << name << ": " << positions - failures << "/" << positions << " positions agree\n";
+    return failures;
+}
+
+// plays games with MCTS under small node budgets, checking that the tree stays inside the
+// budget and that every move the search picks is legal, with and without recycling
+template <class State>
+auto test_node_budget(const char* name, int games, int plies) -> int {
+    int failures = 0;
+    int searches = 0;
+    for (int i = 0; i < games; i++) {
+        size_t budget = State::NUM_ACTIONS + 1 + rng::random_int(4 * State::NUM_ACTIONS);
+        auto engine = MCTS<State>(1, 300, true);
+        engine.set_readout(false);
+        engine.set_node_budget(budget);
+        engine.set_recycle_nodes(i % 2);
+        State node;
+        for (int p = 0; p < plies && !node.is_game_over(); p++) {
+            engine.set_side(node.get_turn());
+            auto next = engine.find_best_next_board(node);
+            bool legal = false;
+            for (auto move : node.legal_moves()) {
+                auto child = node;
+                child.play(move);
+                legal |= child == next;
+            }
+            searches++;
+            if (!legal || engine.get_tree_size() > budget) {
+                std::cout << "budget " << budget << ": " << engine.get_tree_size() << " nodes, legal move: " << legal << "\n";
+                failures++;
+            }
+            node = next;
+        }
+    }
+    std::cout << name << ": " << searches - failures << "/" << searches << " searches within budget\n";
+    return failures;
+}
+
+// the winrate MCTS gives its best move from node, averaged over runs searches. the searches
+// are short enough that the values still rest on the leaves' playouts.
+template <class State, class Configure>
+auto average_winrate(const State& node, int runs, Configure configure) -> double {
+    double total = 0;
+    for (int i = 0; i < runs; i++) {
+        auto engine = MCTS<State>(node.get_turn(), 200, true);
+        engine.set_readout(false);
+        engine.set_use_solved_table(false);
+        configure(engine);
+        engine.find_best_next_board(node);
+        total += engine.get_most_recent_winrate();
+    }
+    return total / runs;
+}
+
+// checks that a search mode values the positions after each of the openings as the tree
+// does. the other modes count a draw as half a win where the tree counts none, so they
+// only agree to within a tolerance.
+template <class State, class Configure>
+auto test_search_mode(const char* name, const std::vector<std::vector<typename State::Move>>& openings, Configure configure) -> int {
+    constexpr int RUNS = 20;
+    constexpr double TOLERANCE = 1.25;
+    int failures = 0;
+    for (const auto& opening : openings) {
+        State node;
+        for (auto move : opening) {
+            node.play(move);
+        }
+        double tree = average_winrate(node, RUNS, [](MCTS<State>&) {});
+        double mode = average_winrate(node, RUNS, configure);
+        if (std::abs(mode - tree) > TOLERANCE) {
+            node.show();
+            std::cout << "tree: " << tree << " " << name << ": " << mode << "\n";
+            failures++;
+        }
+    }
+    std::cout << name << ": " << openings.size() - failures << "/" << openings.size() << " positions agree with the tree\n";
+    return failures;
+}
+
+int main() {
+    int failures = 0;
+    failures += test_solved_table<TicTacToe::State>("TicTacToe", 2000);
+    failures += test_solved_table<Connect4x4::State>("Connect4x4", 500);
+    failures += test_exact_solver<Connect4::State<4, 5>>("Connect4 4x5 solver", 200, 4);
+    failures += test_proof_search<TicTacToe::State>("TicTacToe df-pn", 2000, 0);
+    failures += test_proof_search<Connect4::State<4, 5>>("Connect4 4x5 df-pn", 100, 4);
+    failures += test_node_budget<Gomoku::State<9, 9>>("Gomoku 9x9 node budget", 20, 10);
+    std::vector<std::vector<TicTacToe::State::Move>> openings = {{}, {4}, {0}, {4, 0}};
+    failures += test_search_mode<TicTacToe::State>("TicTacToe graph", openings, [](auto& engine) { engine.set_graph_search(true); });
+    failures += test_search_mode<TicTacToe::State>("TicTacToe compact tree", openings, [](auto& engine) { engine.set_compact_tree(true); });
+    return failures != 0;
+}
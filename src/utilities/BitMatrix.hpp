@@ -65,19 +65,13 @@ class BitMatrix {
     }
 
     auto ctz() const noexcept -> int {
-        // horrible terrible slow approach
-        for (int i = 0; i < SIZE; i++) {
-            if (data[i]) {
-                return i - 1;
-            }
-        }
-        assert(false);
-        return SIZE * 64;
+        // the index of the lowest set bit, or SIZE if there isn't one
+        return data._Find_first();
     }
 
     void reset() {
         // zero out the matrix
-        std::fill(data.begin(), data.end(), 0ULL);
+        data.reset();
     }
 
     auto test_bit(int x) const noexcept -> bool {
@@ -120,12 +114,12 @@ class BitMatrix {
     auto nth_bit(int n) const -> int {
         // return the index of the nth bit set
         // go through the bits set in the matrix
-        while (n) {
-            if (data[n]) {
-                --n;
-            }
+        auto i = data._Find_first();
+        while (n--) {
+            i = data._Find_next(i);
         }
-        return n;
+        assert(i < SIZE);
+        return i;
     }
 
     void clear_bit() {
@@ -156,8 +150,6 @@ class BitMatrix {
         // for this reason, we want a vertical bitmask "column"
         // the column is marked by on-bits at the start of each row
         auto mask = safety_mask<BShiftDir::LEFT>(n);
-        show_bitvec(mask);
-        puts("");
         bb <<= n;
         bb &= mask;
         return bb;
@@ -169,8 +161,6 @@ class BitMatrix {
         // for this reason, we want a vertical bitmask "column"
         // the column is marked by on-bits at the start of each row
         auto mask = safety_mask<BShiftDir::RIGHT>(n);
-        show_bitvec(mask);
-        puts("");
         bb >>= n;
         bb &= mask;
         return bb;
@@ -252,23 +242,57 @@ class BitMatrix {
 
     template <int N>
     auto has_n_in_a_row() const -> bool {
-        using enum Direction;
         // printf("has_n_in_a_row(%d, %d, %d)\n", x, y, n);
         // check if there are n in a row in any direction
-        return has_n_in_a_row<N, VERTICAL>() ||
-               has_n_in_a_row<N, HORIZONTAL>() ||
-               has_n_in_a_row<N, DIAGONAL_45>() ||
-               has_n_in_a_row<N, DIAGONAL_135>();
+        return has_n_in_a_row<N, Direction::VERTICAL>() ||
+               has_n_in_a_row<N, Direction::HORIZONTAL>() ||
+               has_n_in_a_row<N, Direction::DIAGONAL_45>() ||
+               has_n_in_a_row<N, Direction::DIAGONAL_135>();
     }
 
     auto has_n_in_a_row(int n) const -> bool {
-        using enum Direction;
         // printf("has_n_in_a_row(%d, %d, %d)\n", x, y, n);
         // check if there are n in a row in any direction
-        return has_n_in_a_row<VERTICAL>(n) ||
-               has_n_in_a_row<HORIZONTAL>(n) ||
-               has_n_in_a_row<DIAGONAL_45>(n) ||
-               has_n_in_a_row<DIAGONAL_135>(n);
+        return has_n_in_a_row<Direction::VERTICAL>(n) ||
+               has_n_in_a_row<Direction::HORIZONTAL>(n) ||
+               has_n_in_a_row<Direction::DIAGONAL_45>(n) ||
+               has_n_in_a_row<Direction::DIAGONAL_135>(n);
+    }
+
+    // LINE KERNELS
+    // the cells in columns k onwards, for each k
+    static constexpr auto make_columns_from() -> std::array<bitvec, WIDTH + 1> {
+        std::array<bitvec, WIDTH + 1> out = {};
+        for (int k = 0; k <= WIDTH; k++) {
+            for (int i = 0; i < SIZE; i++) {
+                if (i % WIDTH >= k) {
+                    out[k].set(i);
+                }
+            }
+        }
+        return out;
+    }
+    static constexpr auto COLUMNS_FROM = make_columns_from();
+
+    // moves every bit n cells along dir (backwards if n is negative), dropping the bits
+    // that would leave the board instead of wrapping them onto the next row.
+    // shifting back by j lines up the cell j along from every cell with the cell itself,
+    // so ANDing shifted boards matches a line pattern at every anchor at once.
+    static auto shift_along(bitvec bb, Direction dir, int n) -> bitvec {
+        int dr = dir == HORIZONTAL ? 0 : 1;
+        int dc = dir == VERTICAL ? 0 : dir == DIAGONAL_135 ? -1 : 1;
+        int cols = n * dc;
+        if (cols >= WIDTH || cols <= -WIDTH) {
+            return bitvec();
+        }
+        // keep only the bits whose new column is on the board
+        if (cols > 0) {
+            bb &= ~COLUMNS_FROM[WIDTH - cols];
+        } else if (cols < 0) {
+            bb &= COLUMNS_FROM[-cols];
+        }
+        int offset = n * (dr * WIDTH + dc);
+        return offset >= 0 ? bb << offset : bb >> -offset;
     }
 
     friend auto operator|(const BitMatrix& lhs, const BitMatrix& rhs) -> BitMatrix {
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+// a read-only table of bytes backed by a file on disk.
+// if the file is missing (or the wrong size), the table is generated once by the
+// builder and written out, so that every later run only has to map it in.
+class MappedTable {
+    const uint8_t* data = nullptr;
+    size_t size;
+    // where the table lives if it couldn't be written to disk
+    std::vector<uint8_t> fallback;
+
+   public:
+    MappedTable(const std::string& path, size_t size, const std::function<void(uint8_t*)>& builder) : size(size) {
+        if (try_map(path)) {
+            return;
+        }
+        fallback.resize(size);
+        builder(fallback.data());
+        if (write_out(path) && try_map(path)) {
+            fallback = std::vector<uint8_t>();
+            return;
+        }
+        data = fallback.data();
+    }
+    MappedTable(const MappedTable&) = delete;
+    MappedTable(MappedTable&&) = delete;
+    ~MappedTable() noexcept {
+        if (fallback.empty() && data) {
+            munmap(const_cast<uint8_t*>(data), size);
+        }
+    }
+
+    auto operator[](size_t i) const -> uint8_t {
+        return data[i];
+    }
+
+   private:
+    auto try_map(const std::string& path) -> bool {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0 || (size_t)info.st_size != size) {
+            close(fd);
+            return false;
+        }
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return false;
+        }
+        data = static_cast<const uint8_t*>(mapping);
+        return true;
+    }
+
+    auto write_out(const std::string& path) const -> bool {
+        // write to a temporary and rename, so a concurrent reader never sees half a table
+        auto tmp_path = path + ".tmp";
+        FILE* file = fopen(tmp_path.c_str(), "wb");
+        if (!file) {
+            return false;
+        }
+        bool ok = fwrite(fallback.data(), 1, size, file) == size;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+            remove(tmp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+};
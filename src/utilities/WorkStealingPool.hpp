@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of workers, each with its own deque of tasks.
+// a worker pushes and pops at the back of its own deque (so it works depth-first on
+// what it just split), and steals from the front of the others' (taking the oldest,
+// and so usually the largest, pieces of work).
+// the thread that constructs the pool is worker 0: it is expected to call run_one()
+// while it waits on the tasks it has pushed.
+class WorkStealingPool {
+    using Task = std::function<void()>;
+
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+    std::atomic<bool> done = false;
+
+    static inline thread_local int worker_id = 0;
+
+   public:
+    WorkStealingPool(int num_threads) {
+        for (int i = 0; i < num_threads; i++) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        for (int i = 1; i < num_threads; i++) {
+            workers.emplace_back([this, i]() {
+                worker_id = i;
+                while (!done.load(std::memory_order_relaxed)) {
+                    if (!run_one()) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+        }
+    }
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    ~WorkStealingPool() {
+        done = true;
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    void push(Task task) {
+        auto& queue = *queues[worker_id];
+        std::lock_guard guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // runs one task, from this worker's own deque if it has any, else stolen.
+    // returns false if there was nothing to do.
+    auto run_one() -> bool {
+        Task task;
+        {
+            auto& own = *queues[worker_id];
+            std::lock_guard guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+            }
+        }
+        for (size_t i = 1; !task && i < queues.size(); i++) {
+            auto& victim = *queues[(worker_id + i) % queues.size()];
+            std::lock_guard guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
+        if (!task) {
+            return false;
+        }
+        task();
+        return true;
+    }
+};
@@ -1,10 +1,14 @@
 #pragma once
 
+#include <chrono>
+#include <cstdint>
 #include <random>
+#include <vector>
 
 namespace rng {
 
-static auto gen = std::ranlux24(std::chrono::steady_clock::now().time_since_epoch().count());
+// one generator per thread, so that a search running in the background never shares one
+static thread_local auto gen = std::ranlux24(std::chrono::steady_clock::now().time_since_epoch().count());
 
 inline auto random_int(size_t range_size) {
     return gen() % range_size;
@@ -15,4 +19,26 @@ auto choice(const std::vector<T>& vec) -> T {
     return vec[random_int(vec.size())];
 }
 
+// xorshift64*, a much cheaper generator than ranlux24 for use in playout loops.
+class Xorshift64 {
+    uint64_t state;
+
+   public:
+    explicit Xorshift64(uint64_t seed) : state(seed | 1) {}
+
+    auto operator()() -> uint64_t {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1DULL;
+    }
+};
+
+static thread_local auto fast_gen = Xorshift64(std::chrono::steady_clock::now().time_since_epoch().count());
+
+inline auto fast_random_int(uint32_t range_size) -> uint32_t {
+    // maps the top 32 bits onto [0, range_size) with a multiply rather than a modulo
+    return ((fast_gen() >> 32) * range_size) >> 32;
+}
+
 } // namespace rng
\ No newline at end of file
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace simd {
+
+// eight 64-bit lanes: one AVX-512 register, or a pair of AVX2 registers.
+// these are GCC vector extensions, so the compiler lowers them to whatever
+// the target supports (build with -march=native to get AVX2 / AVX-512).
+// no helper takes or returns a vector by value, as the calling convention for
+// them changes with the instruction set, so results go out through a reference.
+constexpr auto LANES = 8;
+using u64xN = uint64_t __attribute__((vector_size(LANES * sizeof(uint64_t))));
+
+inline auto any(const u64xN& v) -> bool {
+    uint64_t acc = 0;
+    for (int i = 0; i < LANES; i++) {
+        acc |= v[i];
+    }
+    return acc;
+}
+
+// sets out to an all-ones mask in every lane where v is non-zero, all-zeros elsewhere
+inline void to_mask(const u64xN& v, u64xN& out) {
+    out = (u64xN)(v != 0);
+}
+
+// xorshift64*, run independently in every lane.
+class Xorshift64xN {
+    u64xN state;
+
+   public:
+    explicit Xorshift64xN(uint64_t seed) {
+        // splitmix64 spreads the seed so the lanes start uncorrelated
+        for (int i = 0; i < LANES; i++) {
+            seed += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            state[i] = (z ^ (z >> 31)) | 1;
+        }
+    }
+
+    void next(u64xN& out) {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        out = state * 0x2545F4914F6CDD1DULL;
+    }
+};
+
+static thread_local auto gen = Xorshift64xN(std::chrono::steady_clock::now().time_since_epoch().count());
+
+// a random integer in [0, range_size) in every lane
+inline void random_int(uint32_t range_size, u64xN& out) {
+    gen.next(out);
+    out = ((out >> 32) * range_size) >> 32;
+}
+
+}  // namespace simd
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// the symmetries of square (and rectangular) boards, and canonical forms under them.
+// a game with symmetries keeps one hash per symmetry, each as if every stone had been
+// placed at its image, and the smallest of them is the same for every member of an
+// orbit. that canonical hash keys the tables that are shared between symmetric positions.
+namespace symmetry {
+
+// the dihedral group of the square: rotations by 0, 90, 180 and 270 degrees, then the
+// reflections in the vertical axis, the main diagonal, the horizontal axis and the
+// anti-diagonal. a rectangular board only has the even-numbered ones.
+enum Symmetry {
+    IDENTITY,
+    ROTATE_90,
+    ROTATE_180,
+    ROTATE_270,
+    MIRROR,
+    TRANSPOSE,
+    FLIP,
+    ANTI_TRANSPOSE,
+};
+
+constexpr auto inverse(int sym) -> int {
+    if (sym == ROTATE_90) {
+        return ROTATE_270;
+    }
+    if (sym == ROTATE_270) {
+        return ROTATE_90;
+    }
+    return sym;
+}
+
+// where the cell at (row, col) on a HEIGHT x WIDTH board goes under sym, as row * WIDTH + col.
+// the odd-numbered symmetries swap rows and columns, so they need WIDTH == HEIGHT.
+constexpr auto transform_cell(int row, int col, int sym, int WIDTH, int HEIGHT) -> int {
+    int r = row, c = col;
+    switch (sym) {
+        case ROTATE_90: r = col; c = WIDTH - 1 - row; break;
+        case ROTATE_180: r = HEIGHT - 1 - row; c = WIDTH - 1 - col; break;
+        case ROTATE_270: r = HEIGHT - 1 - col; c = row; break;
+        case MIRROR: c = WIDTH - 1 - col; break;
+        case TRANSPOSE: r = col; c = row; break;
+        case FLIP: r = HEIGHT - 1 - row; break;
+        case ANTI_TRANSPOSE: r = HEIGHT - 1 - col; c = WIDTH - 1 - row; break;
+    }
+    return r * WIDTH + c;
+}
+
+// TABLE[sym][cell] is the image of cell under sym, for the first N symmetries
+// (N = 8 for a square board, 4 for a rectangle, where the four are 0, 2, 4 and 6).
+template <int WIDTH, int HEIGHT, int N>
+constexpr auto make_cell_table() -> std::array<std::array<int, WIDTH * HEIGHT>, N> {
+    std::array<std::array<int, WIDTH * HEIGHT>, N> table = {};
+    for (int s = 0; s < N; s++) {
+        int sym = N == 8 ? s : 2 * s;
+        for (int cell = 0; cell < WIDTH * HEIGHT; cell++) {
+            table[s][cell] = transform_cell(cell / WIDTH, cell % WIDTH, sym, WIDTH, HEIGHT);
+        }
+    }
+    return table;
+}
+
+// the symmetry whose hash is smallest: mapping a move through it puts the move in the
+// canonical frame, and mapping back through its inverse recovers the original.
+template <class State>
+auto canonical_symmetry(const State& s) -> int {
+    int best = 0;
+    uint64_t best_hash = s.symmetric_hash(0);
+    for (int sym = 1; sym < State::NUM_SYMMETRIES; sym++) {
+        uint64_t h = s.symmetric_hash(sym);
+        if (h < best_hash) {
+            best_hash = h;
+            best = sym;
+        }
+    }
+    return best;
+}
+
+template <class State>
+auto canonical_hash(const State& s) -> uint64_t {
+    return s.symmetric_hash(canonical_symmetry(s));
+}
+
+}  // namespace symmetry
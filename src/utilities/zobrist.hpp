@@ -0,0 +1,28 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace zobrist {
+
+constexpr auto splitmix64(uint64_t& state) -> uint64_t {
+    state += 0x9E3779B97F4A7C15ULL;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// a table of N random keys, generated at compile time.
+// games XOR in one key per (side, square) as pieces come and go.
+template <size_t N>
+constexpr auto make_keys(uint64_t seed) -> std::array<uint64_t, N> {
+    std::array<uint64_t, N> keys = {0};
+    for (auto& key : keys) {
+        key = splitmix64(seed);
+    }
+    return keys;
+}
+
+}  // namespace zobrist